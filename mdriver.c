@@ -20,6 +20,7 @@
 #include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -50,6 +51,7 @@
 
 /***************** Misc *********/
 #define MAXLINE 1024 /* max string size */
+#define FOOTPRINT_SAMPLES 10 /* footprint samples per trace with -R */
 
 /******************************
  * The key compound data types
@@ -98,7 +100,8 @@ typedef struct {
     /* set from the trace parameters */
     const char *filename;
     weight_t weight;
-    unsigned int ops; /* number of ops (malloc/free/realloc) in the trace */
+    unsigned int ops; /* number of ops (malloc/free/realloc) in the trace,
+                         counting each block of a batch op */
 
     /* run-time stats defined for both libc and student */
     bool valid;  /* was the trace processed correctly by the allocator? */
@@ -145,6 +148,14 @@ static unsigned int verbose = REF_ONLY ? 0 : 1; /* verbosity level */
 static int errors = 0; /* number of errs found when running student malloc */
 static bool onetime_flag = false;
 static bool tab_mode = false; /* Print output as tab-separated fields */
+/* If set, report the memory footprint and resident memory over the course
+   of each trace */
+static bool footprint_mode = false;
+/* If set, free blocks with mm_free_sized and check mm_malloc_usable_size
+   against the size of each block */
+static bool sized_mode = false;
+/* If set, print the statistics of the mm package at the end of each trace */
+static bool mm_stats_mode = false;
 /* If set, use sparse memory emulation */
 static bool sparse_mode = SPARSE_MODE;
 static size_t maxfill = SPARSE_MODE ? MAXFILL_SPARSE : MAXFILL;
@@ -186,6 +197,11 @@ static bool add_range(range_set_t *ranges, char *lo, size_t size,
                       unsigned int index);
 static void remove_range(range_set_t *ranges, char *lo);
 static void free_range_set(range_set_t *ranges);
+static bool check_usable_size(const trace_t *trace, unsigned int opnum,
+                              char *p, size_t size);
+static bool check_zeroed(const trace_t *trace, unsigned int opnum, char *p,
+                         size_t size);
+static const char *alloc_name(traceopcode_t type);
 
 /* These functions implement the debugging code */
 static void init_random_data(void);
@@ -201,6 +217,7 @@ static void eval_libc_speed(void *ptr);
    of the student's malloc package in mm.c */
 static bool eval_mm_valid(trace_t *trace, range_set_t *ranges);
 static double eval_mm_util(trace_t *trace, size_t tracenum);
+static void print_mm_stats(const char *name);
 static void eval_mm_speed(void *ptr);
 static double compute_scaled_score(double value, double min, double max);
 
@@ -267,7 +284,7 @@ static void run_tests(size_t num_tracefiles, char **tracefiles,
         trace_t *trace = read_trace(tracefiles[i], verbose);
         mm_stats[i].filename = tracefiles[i];
         mm_stats[i].weight = trace->weight;
-        mm_stats[i].ops = trace->num_ops;
+        mm_stats[i].ops = trace->num_blocks_ops;
 		trace_file = tracefiles[i];
 
         /* Prepare for timeout */
@@ -372,7 +389,7 @@ int main(int argc, char **argv) {
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hpCOVAlDT")) != EOF) {
+    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hpCOVAlDMRST")) != EOF) {
         switch (c) {
 
         case 'A': /* Hidden Autolab driver argument */
@@ -433,6 +450,18 @@ int main(int argc, char **argv) {
             set_timeout = atoui_or_usage(optarg, "-s", argv[0]);
             break;
 
+        case 'M':
+            mm_stats_mode = true;
+            break;
+
+        case 'R':
+            footprint_mode = true;
+            break;
+
+        case 'S':
+            sized_mode = true;
+            break;
+
         case 'T':
             tab_mode = true;
             break;
@@ -494,7 +523,7 @@ int main(int argc, char **argv) {
             trace_t *trace = read_trace(tracefiles[i], verbose);
             libc_stats[i].filename = tracefiles[i];
             libc_stats[i].weight = trace->weight;
-            libc_stats[i].ops = trace->num_ops;
+            libc_stats[i].ops = trace->num_blocks_ops;
 
             if (verbose > 1) {
                 fprintf(stderr,
@@ -775,9 +804,11 @@ static bool add_range(range_set_t *ranges, char *lo, size_t size,
         return false;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-        (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* The payload must lie within the extent of the heap, or within a
+       single region obtained with mem_map */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
+         (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+        !mem_is_mapped(lo, hi)) {
         malloc_error(trace, opnum, "Payload (%p:%p) lies outside heap (%p:%p)",
                      (void *)lo, (void *)hi, (void *)mem_heap_lo(),
                      (void *)mem_heap_hi());
@@ -853,6 +884,61 @@ static void free_range_set(range_set_t *ranges) {
     free(ranges);
 }
 
+/*
+ * check_usable_size - With -S, check that mm_malloc_usable_size reports
+ *     at least the size bytes that request opnum asked for at p, which is
+ *     the size that mm_free_sized will later be passed
+ */
+static bool check_usable_size(const trace_t *trace, unsigned int opnum,
+                              char *p, size_t size) {
+    size_t usable = mm_malloc_usable_size(p);
+    if (usable < size) {
+        malloc_error(trace, opnum,
+                     "Usable size of payload at %p is %zu bytes, "
+                     "less than the %zu requested",
+                     (void *)p, usable, size);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * check_zeroed - check that all size bytes of the payload that calloc
+ *     request opnum returned at p read as zero
+ */
+static bool check_zeroed(const trace_t *trace, unsigned int opnum, char *p,
+                         size_t size) {
+    setUBCheck(false);
+    for (size_t i = 0; i < size; i += sizeof(uint64_t)) {
+        size_t len = size - i;
+        if (len > sizeof(uint64_t))
+            len = sizeof(uint64_t);
+        if (mem_read(p + i, len) != 0) {
+            setUBCheck(true);
+            malloc_error(trace, opnum,
+                         "Payload at %p is not zeroed, starting at byte %zu",
+                         (void *)p, i);
+            return false;
+        }
+    }
+    setUBCheck(true);
+    return true;
+}
+
+/*
+ * alloc_name - name the mm function that an allocating request calls
+ */
+static const char *alloc_name(traceopcode_t type) {
+    switch (type) {
+    case CALLOC:
+        return "calloc";
+    case MEMALIGN:
+        return "memalign";
+    default:
+        return "malloc";
+    }
+}
+
 /**********************************************
  * The following routines handle the random data used for
  * checking memory access.
@@ -968,8 +1054,8 @@ static bool check_index(const trace_t *trace, unsigned int opnum,
  * eval_mm_valid - Check the mm malloc package for correctness
  */
 static bool eval_mm_valid(trace_t *trace, range_set_t *ranges) {
-    unsigned int i;
-    unsigned int index;
+    unsigned int i, j;
+    unsigned int index, count;
     size_t size;
     char *newp;
     char *oldp;
@@ -1013,11 +1099,28 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges) {
 
         switch (trace->ops[i].type) {
 
-        case ALLOC: /* mm_malloc */
+        case ALLOC:    /* mm_malloc */
+        case CALLOC:   /* mm_calloc */
+        case MEMALIGN: /* mm_memalign */
 
-            /* Call the student's malloc */
-            if ((p = mm_malloc(size)) == NULL) {
-                malloc_error(trace, i, "mm_malloc failed");
+            /* Call the student's malloc, calloc or memalign */
+            if (trace->ops[i].type == MEMALIGN) {
+                p = mm_memalign(trace->ops[i].alignment, size);
+            } else if (trace->ops[i].type == CALLOC) {
+                p = mm_calloc(1, size);
+            } else {
+                p = mm_malloc(size);
+            }
+            if (p == NULL) {
+                malloc_error(trace, i, "mm_%s failed",
+                             alloc_name(trace->ops[i].type));
+                return false;
+            }
+            if (trace->ops[i].type == MEMALIGN &&
+                (uintptr_t)p % trace->ops[i].alignment != 0) {
+                malloc_error(trace, i,
+                             "Payload address (%p) not aligned to %zu bytes",
+                             (void *)p, trace->ops[i].alignment);
                 return false;
             }
 
@@ -1028,6 +1131,11 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges) {
              */
             if (add_range(ranges, p, size, trace, i, index) == 0)
                 return false;
+            if (sized_mode && !check_usable_size(trace, i, p, size))
+                return false;
+            if (trace->ops[i].type == CALLOC &&
+                !check_zeroed(trace, i, p, size))
+                return false;
 
             /* Remember region */
             trace->blocks[index] = p;
@@ -1065,6 +1173,8 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges) {
             if (size > 0) {
                 if (add_range(ranges, newp, size, trace, i, index) == 0)
                     return false;
+                if (sized_mode && !check_usable_size(trace, i, newp, size))
+                    return false;
             }
 
             /* Move the region from where it was.
@@ -1093,11 +1203,52 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges) {
             /* Remove region from list and call student's free function */
             if (index == (unsigned int)-1) {
                 p = 0;
+                size = 0;
             } else {
                 p = trace->blocks[index];
+                size = trace->block_sizes[index];
                 remove_range(ranges, p);
             }
-            mm_free(p);
+            if (sized_mode) {
+                mm_free_sized(p, size);
+            } else {
+                mm_free(p);
+            }
+            break;
+
+        case BATCH_ALLOC: /* mm_malloc_batch */
+            count = trace->ops[i].count;
+
+            /* Call the student's malloc_batch */
+            if (mm_malloc_batch(size, count, (void **)&trace->blocks[index]) !=
+                count) {
+                malloc_error(trace, i, "mm_malloc_batch failed");
+                return false;
+            }
+
+            /* Check and remember each block as if mm_malloc returned it */
+            for (j = index; j < index + count; j++) {
+                p = trace->blocks[j];
+                if (add_range(ranges, p, size, trace, i, j) == 0)
+                    return false;
+                if (sized_mode && !check_usable_size(trace, i, p, size))
+                    return false;
+                trace->block_sizes[j] = size;
+                randomize_block(trace, j);
+            }
+            break;
+
+        case BATCH_FREE: /* mm_free_batch */
+            count = trace->ops[i].count;
+            for (j = index; j < index + count; j++) {
+                if (!check_index(trace, i, j)) {
+                    allCheck = false;
+                }
+                remove_range(ranges, trace->blocks[j]);
+            }
+
+            /* This leaves the freed blocks' entries sorted by address */
+            mm_free_batch((void **)&trace->blocks[index], count);
             break;
 
         default:
@@ -1113,21 +1264,24 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges) {
  *   The idea is to remember the high water mark "hwm" of the heap for
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the
- *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   peak memory footprint of the student's malloc package on the
+ *   trace: the size of the heap plus any memory obtained with
+ *   mem_map(), at the point where their sum was largest. Shrinking
+ *   the heap with a negative mem_sbrk() afterwards does not lower it.
  *
  *   A higher number is better: 1 is optimal.
  */
 static double eval_mm_util(trace_t *trace, size_t tracenum) {
-    unsigned int i;
-    unsigned int index;
+    unsigned int i, j;
+    unsigned int index, count;
     size_t size, newsize, oldsize;
     size_t max_total_size = 0;
     size_t total_size = 0;
     char *p;
     char *newp, *oldp;
+    size_t footprints[FOOTPRINT_SAMPLES];
+    size_t residents[FOOTPRINT_SAMPLES];
+    unsigned int samples = 0;
 
     reinit_trace(trace);
 
@@ -1140,13 +1294,22 @@ static double eval_mm_util(trace_t *trace, size_t tracenum) {
 		trace_line = i;
         switch (trace->ops[i].type) {
 
-        case ALLOC: /* mm_alloc */
+        case ALLOC:    /* mm_alloc */
+        case CALLOC:   /* mm_calloc */
+        case MEMALIGN: /* mm_memalign */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
 
-            if ((p = mm_malloc(size)) == NULL) {
-                app_error("trace %zd: mm_malloc failed in eval_mm_util",
-                          tracenum);
+            if (trace->ops[i].type == MEMALIGN) {
+                p = mm_memalign(trace->ops[i].alignment, size);
+            } else if (trace->ops[i].type == CALLOC) {
+                p = mm_calloc(1, size);
+            } else {
+                p = mm_malloc(size);
+            }
+            if (p == NULL) {
+                app_error("trace %zd: mm_%s failed in eval_mm_util", tracenum,
+                          alloc_name(trace->ops[i].type));
             }
 
             /* Remember region and size */
@@ -1191,6 +1354,33 @@ static double eval_mm_util(trace_t *trace, size_t tracenum) {
             total_size -= size;
             break;
 
+        case BATCH_ALLOC: /* mm_malloc_batch */
+            index = trace->ops[i].index;
+            count = trace->ops[i].count;
+            size = trace->ops[i].size;
+
+            if (mm_malloc_batch(size, count,
+                                (void **)&trace->blocks[index]) != count) {
+                app_error("trace %zd: mm_malloc_batch failed in eval_mm_util",
+                          tracenum);
+            }
+            for (j = index; j < index + count; j++) {
+                trace->block_sizes[j] = size;
+            }
+
+            total_size += count * size;
+            break;
+
+        case BATCH_FREE: /* mm_free_batch */
+            index = trace->ops[i].index;
+            count = trace->ops[i].count;
+            for (j = index; j < index + count; j++) {
+                total_size -= trace->block_sizes[j];
+            }
+
+            mm_free_batch((void **)&trace->blocks[index], count);
+            break;
+
         default:
             app_error("trace %zd: Nonexistent request type in eval_mm_util",
                       tracenum);
@@ -1199,9 +1389,63 @@ static double eval_mm_util(trace_t *trace, size_t tracenum) {
         /* update the high-water mark */
         max_total_size =
             (total_size > max_total_size) ? total_size : max_total_size;
+
+        /* sample the footprint at the end of each tenth of the trace */
+        while (footprint_mode && samples < FOOTPRINT_SAMPLES &&
+               (size_t)(i + 1) * FOOTPRINT_SAMPLES >=
+                   (size_t)trace->num_ops * (samples + 1)) {
+            footprints[samples] = mem_footprint();
+            residents[samples++] = mem_resident();
+        }
+    }
+
+    if (footprint_mode) {
+        printf("%s: footprint/resident KB after each %d%% of ops:",
+               trace_file, 100 / FOOTPRINT_SAMPLES);
+        for (i = 0; i < samples; i++) {
+            printf(" %zu/%zu", footprints[i] / 1024, residents[i] / 1024);
+        }
+        printf(" (peak %zu)\n", mem_footprint_peak() / 1024);
+    }
+
+    if (mm_stats_mode) {
+        print_mm_stats(trace_file);
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    /* Memory obtained with mem_map counts towards the heap size */
+    return ((double)max_total_size / (double)mem_footprint_peak());
+}
+
+/*
+ * print_mm_stats - Print a snapshot of the mm package's statistics,
+ *   taken with mm_stats, under the name of the trace.
+ */
+static void print_mm_stats(const char *name) {
+    mm_stats_t st;
+    size_t i;
+
+    mm_stats(&st);
+    printf("%s: heap %zu KB, huge %zu (%zu KB), free %zu (%zu KB), "
+           "binned %zu KB, slabs %zu\n",
+           name, st.heap_bytes / 1024, st.huge_blocks, st.huge_bytes / 1024,
+           st.free_blocks, st.free_bytes / 1024, st.binned_bytes / 1024,
+           st.slabs);
+    printf("%s: extends %zu, trims %zu, splits %zu, coalesces %zu, "
+           "purges %zu, consolidations %zu\n",
+           name, st.heap_extends, st.heap_trims, st.splits, st.coalesces,
+           st.purges, st.consolidations);
+    printf("%s: %10s %10s %10s %10s\n", name, "class", "requests", "free",
+           "free KB");
+    for (i = 0; i < st.num_classes; i++) {
+        const mm_class_stats_t *c = &st.classes[i];
+        if (c->max_size == SIZE_MAX) {
+            printf("%s: %10s", name, "larger");
+        } else {
+            printf("%s: %10zu", name, c->max_size);
+        }
+        printf(" %10zu %10zu %10zu\n", c->requests, c->free_blocks,
+               c->free_bytes / 1024);
+    }
 }
 
 /*
@@ -1209,9 +1453,9 @@ static double eval_mm_util(trace_t *trace, size_t tracenum) {
  *    to measure the running time of the mm malloc package.
  */
 static void eval_mm_speed(void *ptr) {
-    unsigned int i, index;
+    unsigned int i, j, index, count;
     size_t size, newsize;
-    char *p, *newp, *oldp, *block;
+    char *p, *newp, *oldp;
     trace_t *trace = ((speed_t *)ptr)->trace;
     reinit_trace(trace);
 
@@ -1231,6 +1475,28 @@ static void eval_mm_speed(void *ptr) {
             if ((p = mm_malloc(size)) == NULL)
                 app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
+            if (sized_mode)
+                trace->block_sizes[index] = size;
+            break;
+
+        case CALLOC: /* mm_calloc */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_calloc(1, size)) == NULL)
+                app_error("mm_calloc error in eval_mm_speed");
+            trace->blocks[index] = p;
+            if (sized_mode)
+                trace->block_sizes[index] = size;
+            break;
+
+        case MEMALIGN: /* mm_memalign */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_memalign(trace->ops[i].alignment, size)) == NULL)
+                app_error("mm_memalign error in eval_mm_speed");
+            trace->blocks[index] = p;
+            if (sized_mode)
+                trace->block_sizes[index] = size;
             break;
 
         case REALLOC: /* mm_realloc */
@@ -1242,16 +1508,36 @@ static void eval_mm_speed(void *ptr) {
                 app_error("mm_realloc error in eval_mm_speed");
             setUBCheck(true);
             trace->blocks[index] = newp;
+            if (sized_mode)
+                trace->block_sizes[index] = newsize;
             break;
 
         case FREE: /* mm_free */
             index = trace->ops[i].index;
             if (index == (unsigned int)-1) {
-                block = 0;
+                mm_free(NULL);
+            } else if (sized_mode) {
+                mm_free_sized(trace->blocks[index], trace->block_sizes[index]);
             } else {
-                block = trace->blocks[index];
+                mm_free(trace->blocks[index]);
             }
-            mm_free(block);
+            break;
+
+        case BATCH_ALLOC: /* mm_malloc_batch */
+            index = trace->ops[i].index;
+            count = trace->ops[i].count;
+            size = trace->ops[i].size;
+            if (mm_malloc_batch(size, count,
+                                (void **)&trace->blocks[index]) != count)
+                app_error("mm_malloc_batch error in eval_mm_speed");
+            for (j = index; sized_mode && j < index + count; j++)
+                trace->block_sizes[j] = size;
+            break;
+
+        case BATCH_FREE: /* mm_free_batch */
+            index = trace->ops[i].index;
+            count = trace->ops[i].count;
+            mm_free_batch((void **)&trace->blocks[index], count);
             break;
 
         default:
@@ -1267,7 +1553,7 @@ static void eval_mm_speed(void *ptr) {
  *
  */
 static bool eval_libc_valid(trace_t *trace) {
-    unsigned int i;
+    unsigned int i, j;
     size_t newsize;
     char *p, *newp, *oldp;
 
@@ -1284,6 +1570,23 @@ static bool eval_libc_valid(trace_t *trace) {
             trace->blocks[trace->ops[i].index] = p;
             break;
 
+        case CALLOC: /* calloc */
+            if ((p = calloc(1, trace->ops[i].size)) == NULL) {
+                malloc_error(trace, i, "libc calloc failed: %s",
+                             strerror(errno));
+            }
+            trace->blocks[trace->ops[i].index] = p;
+            break;
+
+        case MEMALIGN: /* aligned_alloc */
+            if ((p = aligned_alloc(trace->ops[i].alignment,
+                                   trace->ops[i].size)) == NULL) {
+                malloc_error(trace, i, "libc aligned_alloc failed: %s",
+                             strerror(errno));
+            }
+            trace->blocks[trace->ops[i].index] = p;
+            break;
+
         case REALLOC: /* realloc */
             newsize = trace->ops[i].size;
             oldp = trace->blocks[trace->ops[i].index];
@@ -1302,6 +1605,24 @@ static bool eval_libc_valid(trace_t *trace) {
             }
             break;
 
+        case BATCH_ALLOC: /* one malloc per block */
+            for (j = trace->ops[i].index;
+                 j < trace->ops[i].index + trace->ops[i].count; j++) {
+                if ((p = malloc(trace->ops[i].size)) == NULL) {
+                    malloc_error(trace, i, "libc malloc failed: %s",
+                                 strerror(errno));
+                }
+                trace->blocks[j] = p;
+            }
+            break;
+
+        case BATCH_FREE: /* one free per block */
+            for (j = trace->ops[i].index;
+                 j < trace->ops[i].index + trace->ops[i].count; j++) {
+                free(trace->blocks[j]);
+            }
+            break;
+
         default:
             app_error("invalid operation type  in eval_libc_valid");
         }
@@ -1316,7 +1637,7 @@ static bool eval_libc_valid(trace_t *trace) {
  *    of traces.
  */
 static void eval_libc_speed(void *ptr) {
-    unsigned int i;
+    unsigned int i, j;
     unsigned int index;
     size_t size, newsize;
     char *p, *newp, *oldp, *block;
@@ -1334,6 +1655,22 @@ static void eval_libc_speed(void *ptr) {
             trace->blocks[index] = p;
             break;
 
+        case CALLOC: /* calloc */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = calloc(1, size)) == NULL)
+                unix_error("calloc failed in eval_libc_speed");
+            trace->blocks[index] = p;
+            break;
+
+        case MEMALIGN: /* aligned_alloc */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = aligned_alloc(trace->ops[i].alignment, size)) == NULL)
+                unix_error("aligned_alloc failed in eval_libc_speed");
+            trace->blocks[index] = p;
+            break;
+
         case REALLOC: /* realloc */
             index = trace->ops[i].index;
             newsize = trace->ops[i].size;
@@ -1353,6 +1690,22 @@ static void eval_libc_speed(void *ptr) {
                 free(0);
             }
             break;
+
+        case BATCH_ALLOC: /* one malloc per block */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            for (j = index; j < index + trace->ops[i].count; j++) {
+                if ((p = malloc(size)) == NULL)
+                    unix_error("malloc failed in eval_libc_speed");
+                trace->blocks[j] = p;
+            }
+            break;
+
+        case BATCH_FREE: /* one free per block */
+            index = trace->ops[i].index;
+            for (j = index; j < index + trace->ops[i].count; j++)
+                free(trace->blocks[j]);
+            break;
         }
     }
 }
@@ -1733,7 +2086,7 @@ static unsigned int atoui_or_usage(const char *arg, const char *option,
  * usage - Explain the command line arguments
  */
 static void usage(const char *prog) {
-    fprintf(stderr, "Usage: %s [-hlVCdD] [-f <file>]\n", prog);
+    fprintf(stderr, "Usage: %s [-hlVCdDMRS] [-f <file>]\n", prog);
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-C         Calculate Checkpoint Score.\n");
     fprintf(stderr, "\t-d <i>     Debug: 0 off; 1 default; 2 lots.\n");
@@ -1746,6 +2099,14 @@ static void usage(const char *prog) {
     fprintf(stderr, "\t-V         Print diagnostics as each trace is run.\n");
     fprintf(stderr, "\t-v <i>     Set Verbosity Level to <i>\n");
     fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
+    fprintf(stderr, "\t-M         Print the statistics of the mm package "
+                    "after each trace.\n");
+    fprintf(stderr, "\t-R         Report the memory footprint and resident "
+                    "memory over the\n"
+                    "\t           course of each trace.\n");
+    fprintf(stderr, "\t-S         Free blocks with mm_free_sized, and check "
+                    "that\n"
+                    "\t           mm_malloc_usable_size covers each block.\n");
     fprintf(stderr, "\t-T         Print diagnostics in tab mode\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file\n");
 }
@@ -60,10 +60,31 @@ void markGlobalsUninit(void);
 typedef struct MBLK {
     size_t id;         /* Page ID.  Counts number of pages from start of heap */
     struct MBLK *next; /* Link for hash table */
+    /* Next page of the same mapping, if the page backs a mapping */
+    struct MBLK *map_next;
     unsigned char initSet[SPARSE_PAGE_SIZE / 8];
     unsigned char bytes[SPARSE_PAGE_SIZE]; /* Page contents */
 } mem_block_t;
 
+/* Bookkeeping for a region, kept in the first bytes of the region */
+struct mem_region {
+    unsigned char *lo;        /* First usable byte of the region */
+    unsigned char *brk;       /* Current position of the region's break */
+    unsigned char *brk_chunk; /* ditto, rounded up to a whole page */
+    unsigned char *max_addr;  /* End of the region's reservation */
+    unsigned char *fresh;     /* Region reads as zero from here up */
+};
+
+/* A region of memory obtained with mem_map */
+typedef struct {
+    unsigned char *lo;  /* First byte of the mapping */
+    size_t size;        /* Length of the mapping, a multiple of the page size */
+    struct MBLK *pages; /* Emulated pages backing it, in sparse mode */
+} mem_mapping_t;
+
+/* Maximum number of mappings that may exist at once */
+#define MAX_MAPPINGS (1 << 16)
+
 /* private global variables */
 static bool sparse = false;    /* Use sparse memory emulation */
 static unsigned char *heap;    /* Starting address of heap */
@@ -71,6 +92,7 @@ static unsigned char *mem_brk; /* Current position of break */
 static unsigned char
     *mem_brk_chunk; /* ditto, rounded up to a whole allocation chunk */
 static unsigned char *mem_max_addr; /* Maximum allowable heap address */
+static unsigned char *mem_fresh; /* Heap reads as zero from here up */
 static size_t mmap_length =
     MAX_DENSE_HEAP; /* Number of bytes allocated by mmap */
 static bool show_stats =
@@ -84,6 +106,15 @@ static size_t num_pages = 0;               /* Total number of pages */
 static size_t num_free_pages = 0;          /* Number of free pages */
 static mem_block_t **page_table = NULL;    /* Hash table from page ID to page */
 static size_t num_buckets = 0;             /* Number of buckets in page table */
+static mem_block_t *free_page_list = NULL; /* Pages released by mem_unmap */
+
+/* Mappings, sorted by address and protected by map_lock */
+static mem_mapping_t mappings[MAX_MAPPINGS]; /* Live mappings */
+static size_t num_mappings = 0;              /* Number of live mappings */
+static size_t mapped_bytes = 0;              /* Total size of live mappings */
+static size_t brk_bytes = 0;                 /* Heap size, as of last sbrk */
+static size_t peak_footprint = 0; /* Peak of brk_bytes + mapped_bytes */
+static bool map_lock = false;     /* Spin lock for the fields above */
 
 #ifdef NO_CHECK_UB
 static const bool checkUB = false;
@@ -114,6 +145,23 @@ static size_t page_id(const void *addr);
 static void *page_start(size_t id);
 static void *get_mem(const void *addr, size_t, bool);
 static void print_stats(void);
+static bool map_break(unsigned char *old_brk, intptr_t incr,
+                      unsigned char *brk_chunk);
+static void unmap_break(unsigned char *old_brk, unsigned char *new_brk,
+                        unsigned char *brk_chunk);
+static unsigned char *next_fresh(unsigned char *fresh, unsigned char *new_brk,
+                                 unsigned char *brk_chunk);
+static void forget_writes(unsigned char *new_brk);
+static void release_heap_pages(unsigned char *lo, unsigned char *hi);
+static mem_block_t *find_page(size_t id);
+static size_t count_resident(unsigned char *lo, size_t length);
+static void release_page(mem_block_t *page);
+static void lock_mappings(void);
+static void unlock_mappings(void);
+static size_t find_mapping(const void *addr);
+static void note_footprint(void);
+static void release_pages(mem_mapping_t *mapping);
+static bool emulated(const void *addr, size_t len);
 
 /*
  * Internal helpers
@@ -207,6 +255,7 @@ void mem_init(bool do_sparse) {
     stats_printed = false;
     mem_brk = heap;
     mem_brk_chunk = heap;
+    mem_fresh = heap;
 }
 
 /*
@@ -214,6 +263,7 @@ void mem_init(bool do_sparse) {
  */
 void mem_deinit(void) {
     print_stats();
+    mem_reset_brk();
     munmap(heap, mmap_length);
     next_free_page = NULL;
     num_free_pages = 0;
@@ -251,25 +301,47 @@ void mem_reset_brk(void) {
     }
     mem_brk = heap;
     mem_brk_chunk = heap;
+    mem_fresh = heap;
+
+    /* Drop every mapping along with the heap */
+    lock_mappings();
+    if (!sparse) {
+        for (size_t i = 0; i < num_mappings; i++) {
+            munmap(mappings[i].lo, mappings[i].size);
+        }
+    }
+    num_mappings = 0;
+    mapped_bytes = 0;
+    brk_bytes = 0;
+    peak_footprint = 0;
+    free_page_list = NULL;
+    unlock_mappings();
 }
 
 /*
  * mem_sbrk - simple model of the sbrk function. Extends the heap
  *                by incr bytes and returns the start address of the new area.
- * In this model, the heap cannot be shrunk.
+ * A negative incr shrinks the heap, and the pages wholly above the new
+ * break are given back to the system.
  */
 void *mem_sbrk(intptr_t incr) {
     unsigned char *old_brk = mem_brk;
 
-    if (incr < 0) {
+    if (incr < 0 && (size_t)-incr > (size_t)(mem_brk - heap)) {
         fprintf(stderr,
-                "ERROR: mem_sbrk failed.  Attempt to expand heap by negative "
-                "value %ld\n",
-                (long)incr);
+                "ERROR: mem_sbrk failed.  Attempt to shrink heap by %ld "
+                "bytes, more than its size %td\n",
+                (long)-incr, mem_brk - heap);
         errno = EINVAL;
         return (void *)-1;
     }
-    if (mem_brk + incr > mem_max_addr) {
+    /* In sparse mode, mappings are placed at the top of the address space,
+     * and the heap may only grow up to the lowest one */
+    lock_mappings();
+    unsigned char *limit =
+        (sparse && num_mappings > 0) ? mappings[0].lo : mem_max_addr;
+    unlock_mappings();
+    if (mem_brk + incr > limit) {
         ptrdiff_t alloc = mem_brk - heap + incr;
         fprintf(stderr,
                 "ERROR: mem_sbrk failed. Ran out of memory.  Would require "
@@ -280,38 +352,112 @@ void *mem_sbrk(intptr_t incr) {
     }
 
     unsigned char *new_brk = old_brk + incr;
-    unsigned char *new_brk_chunk = round_address_up(new_brk, mem_pagesize());
-    if (!sparse) {
-        /* Make the requested section of the heap be accessible.
-         * sbrk accepts any 'incr' value, but mprotect only works on
-         * full pages.
-         */
-        if (new_brk_chunk > mem_brk_chunk &&
-            mprotect(mem_brk_chunk, (size_t)(new_brk_chunk - mem_brk_chunk),
-                     PROT_READ | PROT_WRITE) == -1) {
-            fprintf(stderr,
-                    "ERROR: making %zd bytes at %p accessible failed (%s)\n",
-                    new_brk_chunk - mem_brk_chunk, (void *)mem_brk_chunk,
-                    strerror(errno));
-            return (void *)-1;
+    if (incr < 0) {
+        if (sparse) {
+            forget_writes(new_brk);
+            release_heap_pages(new_brk,
+                               round_address_up(old_brk, SPARSE_PAGE_SIZE));
+        } else {
+            unmap_break(old_brk, new_brk, mem_brk_chunk);
         }
+    } else if (!sparse && !map_break(old_brk, incr, mem_brk_chunk)) {
+        return (void *)-1;
+    }
+
+    mem_fresh = next_fresh(mem_fresh, new_brk, mem_brk_chunk);
+    mem_brk_chunk = round_address_up(new_brk, mem_pagesize());
+    mem_brk = new_brk;
+
+    lock_mappings();
+    brk_bytes = (size_t)(mem_brk - heap);
+    note_footprint();
+    unlock_mappings();
+    return old_brk;
+}
+
+/*
+ * map_break - make the incr bytes of a dense heap or region that follow
+ *     old_brk accessible, given the current break rounded up to a page
+ */
+static bool map_break(unsigned char *old_brk, intptr_t incr,
+                      unsigned char *brk_chunk) {
+    unsigned char *new_brk = old_brk + incr;
+    unsigned char *new_brk_chunk = round_address_up(new_brk, mem_pagesize());
+    /* Make the requested section of the heap be accessible.
+     * sbrk accepts any 'incr' value, but mprotect only works on
+     * full pages.
+     */
+    if (new_brk_chunk > brk_chunk &&
+        mprotect(brk_chunk, (size_t)(new_brk_chunk - brk_chunk),
+                 PROT_READ | PROT_WRITE) == -1) {
+        fprintf(stderr, "ERROR: making %zd bytes at %p accessible failed (%s)\n",
+                new_brk_chunk - brk_chunk, (void *)brk_chunk, strerror(errno));
+        return false;
+    }
 #ifdef USE_ASAN
-        /* Tell ASan the precise location of the break.  */
-        __asan_unpoison_memory_region(old_brk, (size_t)incr);
-        if (new_brk < new_brk_chunk) {
-            __asan_poison_memory_region(new_brk,
-                                        (size_t)(new_brk_chunk - new_brk));
-        }
+    /* Tell ASan the precise location of the break.  */
+    __asan_unpoison_memory_region(old_brk, (size_t)incr);
+    if (new_brk < new_brk_chunk) {
+        __asan_poison_memory_region(new_brk, (size_t)(new_brk_chunk - new_brk));
+    }
 #endif
 #ifdef USE_MSAN
-        /* Mark the requested section of the heap as uninitialized.  */
-        __msan_allocated_memory(mem_brk, (size_t)incr);
+    /* Mark the requested section of the heap as uninitialized.  */
+    __msan_allocated_memory(old_brk, (size_t)incr);
 #endif
+    return true;
+}
+
+/*
+ * unmap_break - give back the pages of a dense heap or region that lie
+ *     wholly above new_brk, given the current break rounded up to a page.
+ *     They are made inaccessible again and their contents discarded, so
+ *     that they no longer count towards the resident set.
+ */
+static void unmap_break(unsigned char *old_brk, unsigned char *new_brk,
+                        unsigned char *brk_chunk) {
+    unsigned char *new_brk_chunk = round_address_up(new_brk, mem_pagesize());
+    if (new_brk_chunk < brk_chunk) {
+        size_t length = (size_t)(brk_chunk - new_brk_chunk);
+        if (mprotect(new_brk_chunk, length, PROT_NONE) == -1 ||
+            madvise(new_brk_chunk, length, MADV_DONTNEED) == -1) {
+            fprintf(stderr, "ERROR: releasing %zu bytes at %p failed (%s)\n",
+                    length, (void *)new_brk_chunk, strerror(errno));
+        }
     }
+#ifdef USE_ASAN
+    __asan_poison_memory_region(new_brk, (size_t)(old_brk - new_brk));
+#else
+    (void)old_brk;
+#endif
+}
 
-    mem_brk_chunk = new_brk_chunk;
-    mem_brk = new_brk;
-    return old_brk;
+/*
+ * next_fresh - return the lowest address from which a dense heap or region
+ *     reads as zero once its break moves to new_brk, given that it did so
+ *     from fresh, and the current break rounded up to a page.  The pages
+ *     that unmap_break gives back come back zeroed, but the rest of the
+ *     page holding the break keeps whatever was written to it.
+ */
+static unsigned char *next_fresh(unsigned char *fresh, unsigned char *new_brk,
+                                 unsigned char *brk_chunk) {
+    unsigned char *new_brk_chunk = round_address_up(new_brk, mem_pagesize());
+    if (new_brk_chunk < brk_chunk) {
+        return new_brk_chunk;
+    }
+    return (new_brk > fresh) ? new_brk : fresh;
+}
+
+/*
+ * mem_heap_fresh - return the lowest address from which the heap reads as
+ *     zero, or the end of its address range if nothing is known to
+ */
+void *mem_heap_fresh(void) {
+#ifdef USE_MSAN
+    return (void *)mem_max_addr;
+#else
+    return (void *)(sparse ? mem_max_addr : mem_fresh);
+#endif
 }
 
 /*
@@ -351,6 +497,326 @@ size_t mem_pagesize(void) {
     return pagesize;
 }
 
+/*************** Regions  *******************/
+
+/*
+ * mem_region_create - reserve a region of size bytes, aligned to size,
+ *     with its own break.  Only the dense heap supports regions.
+ */
+mem_region_t *mem_region_create(size_t size) {
+    size_t pagesize = mem_pagesize();
+    if (sparse) {
+        errno = ENOSYS;
+        return NULL;
+    }
+    if (size < pagesize || (size & (size - 1)) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    /* Over-reserve so that an aligned range of size bytes fits, then
+     * give back the misaligned head and the unused tail */
+    unsigned char *addr = mmap(NULL, 2 * size, PROT_NONE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+        return NULL;
+    }
+    unsigned char *base = round_address_up(addr, size);
+    if (base > addr) {
+        munmap(addr, (size_t)(base - addr));
+    }
+    munmap(base + size, (size_t)(addr + size - base));
+
+    /* The bookkeeping lives at the start of the region */
+    if (mprotect(base, pagesize, PROT_READ | PROT_WRITE) == -1) {
+        munmap(base, size);
+        return NULL;
+    }
+    mem_region_t *region = (mem_region_t *)base;
+    region->lo = round_address_up(base + sizeof(mem_region_t), ALIGNMENT);
+    region->brk = region->lo;
+    region->brk_chunk = base + pagesize;
+    region->max_addr = base + size;
+    region->fresh = region->lo;
+#ifdef USE_ASAN
+    __asan_poison_memory_region(region->lo,
+                                (size_t)(region->brk_chunk - region->lo));
+#endif
+    return region;
+}
+
+/*
+ * mem_region_destroy - release a region and everything in it
+ */
+void mem_region_destroy(mem_region_t *region) {
+    unsigned char *base = (unsigned char *)region;
+    munmap(base, (size_t)(region->max_addr - base));
+}
+
+/*
+ * mem_region_sbrk - extend the break of a region by incr bytes and
+ *     return the start address of the new area.  A negative incr shrinks
+ *     the region, as with mem_sbrk.
+ */
+void *mem_region_sbrk(mem_region_t *region, intptr_t incr) {
+    unsigned char *old_brk = region->brk;
+
+    if (incr < 0 && (size_t)-incr > (size_t)(region->brk - region->lo)) {
+        errno = EINVAL;
+        return (void *)-1;
+    }
+    if (region->brk + incr > region->max_addr) {
+        errno = ENOMEM;
+        return (void *)-1;
+    }
+    if (incr < 0) {
+        unmap_break(old_brk, old_brk + incr, region->brk_chunk);
+    } else if (!map_break(old_brk, incr, region->brk_chunk)) {
+        return (void *)-1;
+    }
+
+    region->fresh = next_fresh(region->fresh, old_brk + incr, region->brk_chunk);
+    region->brk_chunk = round_address_up(old_brk + incr, mem_pagesize());
+    region->brk = old_brk + incr;
+    return old_brk;
+}
+
+/*
+ * mem_region_fresh - return the lowest address from which a region reads
+ *     as zero, or the end of the region if nothing is known to
+ */
+void *mem_region_fresh(mem_region_t *region) {
+#ifdef USE_MSAN
+    return (void *)region->max_addr;
+#else
+    return (void *)region->fresh;
+#endif
+}
+
+/*
+ * mem_region_lo - return address of the first usable byte of a region
+ */
+void *mem_region_lo(mem_region_t *region) {
+    return (void *)region->lo;
+}
+
+/*
+ * mem_region_hi - return address of the last byte below a region's break
+ */
+void *mem_region_hi(mem_region_t *region) {
+    return (void *)(region->brk - 1);
+}
+
+/*
+ * mem_region_heapsize - return the number of bytes below a region's break
+ */
+size_t mem_region_heapsize(mem_region_t *region) {
+    return (size_t)(region->brk - region->lo);
+}
+
+/*
+ * mem_region_of - return the region of size bytes that contains addr
+ */
+mem_region_t *mem_region_of(const void *addr, size_t size) {
+    return (mem_region_t *)round_address_down((void *)addr, size);
+}
+
+/*
+ * mem_in_heap - return whether addr lies in the range reserved for the
+ *     heap, as opposed to a region
+ */
+bool mem_in_heap(const void *addr) {
+    const unsigned char *p = addr;
+    return p >= heap && p < mem_max_addr;
+}
+
+/*************** Mappings  *******************/
+
+/*
+ * mem_map - model of mmap: map size bytes (rounded up to whole pages)
+ *     outside the heap.  The dense heap maps fresh pages, and sparse mode
+ *     emulates them at the top of the emulated address space.
+ */
+void *mem_map(size_t size) {
+    size = (size_t)round_address_up((void *)size, mem_pagesize());
+    if (size == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    unsigned char *addr = NULL;
+    if (!sparse) {
+        addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED) {
+            return NULL;
+        }
+#ifdef USE_MSAN
+        __msan_allocated_memory(addr, size);
+#endif
+    }
+
+    lock_mappings();
+    if (sparse) {
+        /* Take the highest gap that fits, above the heap's break */
+        unsigned char *hi = mem_max_addr;
+        for (size_t i = num_mappings + 1; i-- > 0;) {
+            unsigned char *gap_lo =
+                (i > 0) ? mappings[i - 1].lo + mappings[i - 1].size : mem_brk;
+            if ((size_t)(hi - gap_lo) >= size) {
+                addr = hi - size;
+                break;
+            }
+            if (i > 0) {
+                hi = mappings[i - 1].lo;
+            }
+        }
+    }
+    if (addr == NULL || num_mappings == MAX_MAPPINGS) {
+        if (addr != NULL && !sparse) {
+            munmap(addr, size);
+        }
+        unlock_mappings();
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* Keep the table sorted by address */
+    size_t i = num_mappings;
+    while (i > 0 && mappings[i - 1].lo > addr) {
+        mappings[i] = mappings[i - 1];
+        i--;
+    }
+    mappings[i].lo = addr;
+    mappings[i].size = size;
+    mappings[i].pages = NULL;
+    num_mappings++;
+    mapped_bytes += size;
+    note_footprint();
+    unlock_mappings();
+    return addr;
+}
+
+/*
+ * mem_map_zeroed - return whether new mappings read as zero, which only
+ *     dense ones do; emulated pages are recycled as they are
+ */
+bool mem_map_zeroed(void) {
+#ifdef USE_MSAN
+    return false;
+#else
+    return !sparse;
+#endif
+}
+
+/*
+ * mem_unmap - model of munmap: release a mapping made by mem_map
+ */
+void mem_unmap(void *addr, size_t size) {
+    size = (size_t)round_address_up((void *)size, mem_pagesize());
+
+    lock_mappings();
+    size_t i = find_mapping(addr);
+    if (i == num_mappings || mappings[i].lo != addr ||
+        mappings[i].size != size) {
+        unlock_mappings();
+        fprintf(stderr,
+                "ERROR: mem_unmap failed.  %p:%zu bytes was not mapped by "
+                "mem_map\n",
+                addr, size);
+        return;
+    }
+    /* Unmap while still holding the lock, so that the address cannot be
+     * handed out again before it leaves the table */
+    if (sparse) {
+        release_pages(&mappings[i]);
+    } else {
+        munmap(addr, size);
+    }
+    num_mappings--;
+    for (; i < num_mappings; i++) {
+        mappings[i] = mappings[i + 1];
+    }
+    mapped_bytes -= size;
+    unlock_mappings();
+}
+
+/*
+ * mem_is_mapped - return whether the bytes lo...hi lie in one mapping
+ */
+bool mem_is_mapped(const void *lo, const void *hi) {
+    lock_mappings();
+    size_t i = find_mapping(lo);
+    bool mapped = i < num_mappings &&
+                  (const unsigned char *)hi < mappings[i].lo + mappings[i].size;
+    unlock_mappings();
+    return mapped;
+}
+
+/*
+ * mem_footprint - return the heap size plus the size of all mappings
+ */
+size_t mem_footprint(void) {
+    lock_mappings();
+    size_t footprint = brk_bytes + mapped_bytes;
+    unlock_mappings();
+    return footprint;
+}
+
+/*
+ * mem_footprint_peak - return the peak of the heap size plus the size of
+ *     all mappings since the heap was last reset
+ */
+size_t mem_footprint_peak(void) {
+    lock_mappings();
+    size_t peak = peak_footprint;
+    unlock_mappings();
+    return peak;
+}
+
+/*************** Purging  *******************/
+
+/*
+ * mem_purge - model of madvise(MADV_DONTNEED): discard the contents of
+ *     the pages that lie wholly within addr...addr+size-1, which must be
+ *     below the break of the heap or of a region.  The pages stay
+ *     accessible, but are no longer resident until they are written again.
+ */
+void mem_purge(void *addr, size_t size) {
+    unsigned char *lo = addr;
+    unsigned char *hi = lo + size;
+    if (sparse) {
+        release_heap_pages(lo, hi);
+        return;
+    }
+
+    lo = round_address_up(lo, mem_pagesize());
+    hi = round_address_down(hi, mem_pagesize());
+    if (lo < hi && madvise(lo, (size_t)(hi - lo), MADV_DONTNEED) == -1) {
+        fprintf(stderr, "ERROR: purging %zu bytes at %p failed (%s)\n",
+                (size_t)(hi - lo), (void *)lo, strerror(errno));
+    }
+}
+
+/*
+ * mem_resident - return the number of bytes of the heap and of all
+ *     mappings that are backed by memory: the pages mincore reports as
+ *     resident with the dense heap, and the emulated pages in sparse mode
+ */
+size_t mem_resident(void) {
+    if (sparse) {
+        return (num_pages - num_free_pages) * SPARSE_PAGE_SIZE;
+    }
+
+    size_t resident = count_resident(heap, (size_t)(mem_brk_chunk - heap));
+    lock_mappings();
+    for (size_t i = 0; i < num_mappings; i++) {
+        resident += count_resident(mappings[i].lo, mappings[i].size);
+    }
+    unlock_mappings();
+    return resident;
+}
+
 /*************** Memory emulation  *******************/
 
 __int128_t mem_read128(const void *addr) {
@@ -368,8 +834,7 @@ void mem_write128(void *addr, __int128_t val) {
 /* Read len bytes and return value zero-extended to 64 bits */
 uint64_t mem_read(const void *addr, size_t len) {
     uint64_t rdata;
-    if (sparse && (unsigned char *)addr >= heap &&
-        (unsigned char *)addr + len <= mem_brk) {
+    if (sparse && emulated(addr, len)) {
         /* Heap read.  Check if it crosses page boundary */
         size_t id = page_id(addr);
         void *paddr = get_mem(addr, len, false);
@@ -407,8 +872,7 @@ uint64_t mem_read(const void *addr, size_t len) {
 
 /* Write lower order len bytes of val to address */
 void mem_write(void *addr, uint64_t val, size_t len) {
-    if (sparse && (unsigned char *)addr >= heap &&
-        (unsigned char *)addr + len <= mem_brk) {
+    if (sparse && emulated(addr, len)) {
         /* Heap write.  Check to see if it crosses page boundary */
         size_t id = page_id(addr);
         void *paddr = get_mem(addr, len, true);
@@ -530,6 +994,149 @@ static void print_stats(void) {
     stats_printed = true;
 }
 
+/*
+ * Return the number of bytes in the length bytes at the page-aligned
+ * address lo that are resident in memory, according to mincore
+ */
+static size_t count_resident(unsigned char *lo, size_t length) {
+    unsigned char vec[1024];
+    size_t pagesize = mem_pagesize();
+    size_t pages = (length + pagesize - 1) / pagesize;
+    size_t resident = 0;
+
+    for (size_t done = 0; done < pages; done += sizeof(vec)) {
+        size_t n = pages - done < sizeof(vec) ? pages - done : sizeof(vec);
+        if (mincore(lo + done * pagesize, n * pagesize, vec) == -1)
+            return resident;
+        for (size_t i = 0; i < n; i++)
+            resident += (vec[i] & 1) * pagesize;
+    }
+    return resident;
+}
+
+/* Spin locks protecting the mapping table and footprint counters */
+static void lock_mappings(void) {
+    while (__atomic_test_and_set(&map_lock, __ATOMIC_ACQUIRE))
+        ;
+}
+
+static void unlock_mappings(void) {
+    __atomic_clear(&map_lock, __ATOMIC_RELEASE);
+}
+
+/*
+ * Return the index of the mapping with the highest start address not
+ * above addr, or num_mappings if there is none containing addr.
+ * The caller holds map_lock.
+ */
+static size_t find_mapping(const void *addr) {
+    const unsigned char *p = addr;
+    size_t lo = 0, hi = num_mappings;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (mappings[mid].lo <= p)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == 0 || p >= mappings[lo - 1].lo + mappings[lo - 1].size)
+        return num_mappings;
+    return lo - 1;
+}
+
+/* Update the peak footprint.  The caller holds map_lock. */
+static void note_footprint(void) {
+    size_t footprint = brk_bytes + mapped_bytes;
+    if (footprint > peak_footprint)
+        peak_footprint = footprint;
+}
+
+/*
+ * Return the emulated pages backing a mapping to the free page list.
+ * The caller holds map_lock.
+ */
+static void release_pages(mem_mapping_t *mapping) {
+    mem_block_t *page = mapping->pages;
+    while (page != NULL) {
+        mem_block_t *next = page->map_next;
+        release_page(page);
+        page = next;
+    }
+    mapping->pages = NULL;
+}
+
+/*
+ * Forget which bytes of the emulated page holding new_brk were written at
+ * or above it, so that they read as uninitialized if the heap regrows
+ */
+static void forget_writes(unsigned char *new_brk) {
+    size_t id = page_id(new_brk);
+    mem_block_t *page = find_page(id);
+    if (page != NULL) {
+        size_t offset = (size_t)(new_brk - (unsigned char *)page_start(id));
+        for (size_t i = offset; i < SPARSE_PAGE_SIZE; i++)
+            page->initSet[i / 8] &= (unsigned char)~(1u << (i % 8));
+    }
+}
+
+/*
+ * Return the emulated heap pages that lie wholly within lo...hi-1 to the
+ * free page list.  Looks the pages up one by one if there are fewer of
+ * them than pages in use, and otherwise sweeps the whole page table.
+ */
+static void release_heap_pages(unsigned char *lo, unsigned char *hi) {
+    size_t first = page_id(lo + SPARSE_PAGE_SIZE - 1);
+    size_t end = page_id(hi);
+    if (end <= first)
+        return;
+
+    if (end - first < num_pages - num_free_pages) {
+        for (size_t id = first; id < end; id++) {
+            mem_block_t *page = find_page(id);
+            if (page != NULL)
+                release_page(page);
+        }
+        return;
+    }
+    for (size_t b = 0; b < num_buckets; b++) {
+        mem_block_t *page = page_table[b];
+        while (page != NULL) {
+            mem_block_t *next = page->next;
+            if (page->id >= first && page->id < end)
+                release_page(page);
+            page = next;
+        }
+    }
+}
+
+/* Return the emulated page with the given ID, or NULL if it has none */
+static mem_block_t *find_page(size_t id) {
+    mem_block_t *page = page_table[id % num_buckets];
+    while (page != NULL && page->id != id)
+        page = page->next;
+    return page;
+}
+
+/* Move an emulated page from the page table to the free page list */
+static void release_page(mem_block_t *page) {
+    mem_block_t **link = &page_table[page->id % num_buckets];
+    while (*link != page)
+        link = &(*link)->next;
+    *link = page->next;
+    page->next = free_page_list;
+    free_page_list = page;
+    num_free_pages++;
+}
+
+/* Return whether addr...addr+len-1 is emulated memory in sparse mode */
+static bool emulated(const void *addr, size_t len) {
+    const unsigned char *p = addr;
+    if (p >= heap && p + len <= mem_brk)
+        return true;
+    /* Anything above the lowest mapping belongs to the mapping area */
+    return num_mappings > 0 && p >= mappings[0].lo && p + len <= mem_max_addr;
+}
+
 /* Given an address, compute the ID  of its page */
 static size_t page_id(const void *addr) {
     ptrdiff_t offset =
@@ -565,10 +1172,23 @@ static void *get_mem(const void *addr, size_t size, bool isWrite) {
             fprintf(stderr, "FAILURE.  Ran out of memory for emulation\n");
             exit(1);
         }
-        block = next_free_page++;
+        if (free_page_list != NULL) {
+            block = free_page_list;
+            free_page_list = block->next;
+        } else {
+            block = next_free_page++;
+        }
         num_free_pages--;
         block->id = id;
         block->next = page_table[b];
+        block->map_next = NULL;
+        /* Remember the pages of each mapping, to release them on unmap.
+         * Sparse mode is single-threaded, so map_lock is not needed. */
+        size_t m = find_mapping(addr);
+        if (m < num_mappings) {
+            block->map_next = mappings[m].pages;
+            mappings[m].pages = block;
+        }
         for (i = 0; i < (SPARSE_PAGE_SIZE / 8); i++)
             block->initSet[i] = 0;
         page_table[b] = block;
@@ -26,16 +26,30 @@ void mem_deinit(void);
 /**
  * @brief Extends the heap by incr bytes.
  *
- * This function is a simple model of the sbrk() function, except for that
- * with this implementation, the heap cannot be shrunk.
+ * This function is a simple model of the sbrk() function. A negative
+ * `incr` shrinks the heap, and the pages wholly above the new break are
+ * returned to the system, so their contents are lost.
  *
  * @param[in] incr The amount of bytes by which to extend the heap
  * @return The start address of the new heap area (i.e. the previous
  *         breakpoint)
- * @pre `incr > 0`
+ * @pre `-incr` is at most the size of the heap
  */
 void *mem_sbrk(intptr_t incr);
 
+/**
+ * @brief Finds the lowest address from which the heap reads as zero.
+ *
+ * No byte at or above this address has been accessible since its page was
+ * last zeroed, so the part of the next mem_sbrk extension that lies at or
+ * above it reads as zero. The address is never below the break. Sparse
+ * mode and MemorySanitizer builds promise no zeroed memory, and return the
+ * end of the address range the heap may grow into.
+ *
+ * @return The start of the zeroed memory above the break
+ */
+void *mem_heap_fresh(void);
+
 /**
  * @brief Resets the simulated brk pointer to make an empty heap.
  */
@@ -69,6 +83,160 @@ size_t mem_heapsize(void);
  */
 size_t mem_pagesize(void);
 
+/* Regions: heaps of their own, outside the main heap */
+
+/** @brief A region of address space with its own break */
+typedef struct mem_region mem_region_t;
+
+/**
+ * @brief Reserves a region of address space with its own break.
+ *
+ * The region starts out empty and is aligned to its size, so that the
+ * region containing any address in it is found by mem_region_of. Regions
+ * are only available with the dense heap.
+ *
+ * @param[in] size The size of the reservation, in bytes
+ * @return The new region, or NULL on failure
+ * @pre `size` is a power of two and at least the page size
+ */
+mem_region_t *mem_region_create(size_t size);
+
+/**
+ * @brief Releases a region and all of the memory in it.
+ * @param[in] region A region returned by mem_region_create
+ */
+void mem_region_destroy(mem_region_t *region);
+
+/**
+ * @brief Extends a region's break by incr bytes, like mem_sbrk.
+ * @param[in] region The region to extend
+ * @param[in] incr The amount of bytes by which to extend the region, or
+ *                 to shrink it by if negative
+ * @return The start address of the new area, or (void *)-1 on failure
+ */
+void *mem_region_sbrk(mem_region_t *region, intptr_t incr);
+
+/**
+ * @brief Finds the lowest address from which a region reads as zero, like
+ *        mem_heap_fresh.
+ * @param[in] region
+ * @return The start of the zeroed memory above the region's break
+ */
+void *mem_region_fresh(mem_region_t *region);
+
+/**
+ * @brief Finds the low address of a region.
+ * @param[in] region
+ * @return The address of the first usable byte in the region.
+ */
+void *mem_region_lo(mem_region_t *region);
+
+/**
+ * @brief Finds the high address of a region.
+ * @param[in] region
+ * @return The address of the last byte below the region's break.
+ */
+void *mem_region_hi(mem_region_t *region);
+
+/**
+ * @brief Returns the number of bytes being used by a region.
+ * @param[in] region
+ * @return The distance from the region's low address to its break
+ */
+size_t mem_region_heapsize(mem_region_t *region);
+
+/**
+ * @brief Finds the region containing an address.
+ * @param[in] addr An address inside a region
+ * @param[in] size The size the region was created with
+ * @return The region containing `addr`
+ */
+mem_region_t *mem_region_of(const void *addr, size_t size);
+
+/**
+ * @brief Returns whether an address lies in the range reserved for the
+ *        main heap, rather than in a region.
+ * @param[in] addr
+ * @return True if `addr` belongs to the main heap
+ */
+bool mem_in_heap(const void *addr);
+
+/* Mappings: memory outside the heap, released individually */
+
+/**
+ * @brief Maps fresh memory outside the heap, like mmap.
+ *
+ * The dense heap maps new pages from the system. Sparse mode emulates the
+ * mapping at the top of the emulated address space, above the heap.
+ *
+ * @param[in] size The number of bytes to map, rounded up to whole pages
+ * @return The page-aligned start of the mapping, or NULL on failure
+ */
+void *mem_map(size_t size);
+
+/**
+ * @brief Returns whether the memory mem_map hands out reads as zero.
+ *
+ * Dense mappings come straight from the system, zero-filled. Emulated
+ * pages are recycled without being cleared, and MemorySanitizer treats
+ * new mappings as uninitialized, so neither counts as zeroed.
+ *
+ * @return True if every new mapping reads as zero
+ */
+bool mem_map_zeroed(void);
+
+/**
+ * @brief Releases a mapping made by mem_map, like munmap.
+ * @param[in] addr The start of the mapping
+ * @param[in] size The size the mapping was made with
+ */
+void mem_unmap(void *addr, size_t size);
+
+/**
+ * @brief Returns whether a range of bytes lies within a single mapping.
+ * @param[in] lo The first byte of the range
+ * @param[in] hi The last byte of the range
+ * @return True if `lo` through `hi` belong to one live mapping
+ */
+bool mem_is_mapped(const void *lo, const void *hi);
+
+/**
+ * @brief Returns the current memory footprint: the heap size plus the size
+ *        of all live mappings.
+ * @return The footprint, in bytes
+ */
+size_t mem_footprint(void);
+
+/**
+ * @brief Returns the peak memory footprint since the heap was last reset.
+ *
+ * The footprint is the heap size plus the size of all live mappings.
+ *
+ * @return The largest footprint reached, in bytes
+ */
+size_t mem_footprint_peak(void);
+
+/**
+ * @brief Discards the contents of the pages in a range, like
+ *        madvise(MADV_DONTNEED).
+ *
+ * Only the pages that lie wholly within the range are affected. They stay
+ * accessible, but no longer take up memory until they are written again.
+ * Afterwards their bytes read as zero with the dense heap, and count as
+ * uninitialized in sparse mode.
+ *
+ * @param[in] addr The start of the range
+ * @param[in] size The length of the range, in bytes
+ * @pre The range lies below the break of the heap or of a region
+ */
+void mem_purge(void *addr, size_t size);
+
+/**
+ * @brief Returns how much of the heap and of all mappings is resident.
+ * @return The number of bytes backed by memory
+ */
+size_t mem_resident(void);
+
 /* Functions used for memory emulation */
 
 /**
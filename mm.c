@@ -1,10 +1,94 @@
 /**
  * @file mm.c
- * @brief A 64-bit struct-based implicit free list memory allocator
+ * @brief A 64-bit struct-based segregated free list memory allocator
  *
  * 15-213: Introduction to Computer Systems
  *
- * TODO: insert your documentation here. :)
+ * Every block in the heap starts with a one-word header holding the block
+ * size, its allocation status, and the allocation status of the previous
+ * block in the heap. Allocated blocks have no footer, so their payload
+ * extends to the end of the block. Free blocks additionally store a footer
+ * in their last word, and use the first two words of their payload to hold
+ * the `next` and `prev` links of an explicit, doubly linked free list. The
+ * footer is only read when the previous-allocated bit of the following
+ * block says it exists.
+ *
+ * Requests of up to 8 bytes are served from 16-byte mini blocks, which are
+ * too small for a footer and a `prev` link. Free mini blocks are kept on a
+ * separate singly linked list, and each header carries a third flag saying
+ * whether the previous block is a mini block, so that a mini block can be
+ * located without a footer.
+ *
+ * Free blocks are bucketed into NUM_SEG_LISTS segregated lists by size
+ * class. By default, class 0 holds blocks of exactly min_block_size bytes,
+ * and each following class covers the next power-of-two range of sizes.
+ * The Makefile instead fits the classes to the request sizes of the traces
+ * with sizeclasses.pl, so that each list serves a similar share. Freed
+ * blocks are pushed onto the front of their class list (LIFO), and
+ * `malloc` searches only the lists whose class can hold the request, so
+ * neither operation depends on the number of allocated blocks in the heap.
+ * A bitmap records which classes are non-empty, so that the first usable
+ * larger class is found with a single count-trailing-zeros instead of a
+ * walk over empty lists.
+ *
+ * Requests of huge_threshold bytes or more bypass the heap altogether. Each
+ * is given a page-aligned mapping of its own from mem_map, flagged as huge
+ * in its header, which is unmapped again when the block is freed.
+ * Likewise, once the free block at the end of the heap reaches
+ * trim_threshold bytes, all but trim_keep bytes of it are given back with
+ * a negative mem_sbrk, so that a passing spike does not pin the heap.
+ * Inside the heap, large free blocks that stay free for a whole purge
+ * epoch have their pages released with mem_purge, while remaining free
+ * blocks like any other.
+ *
+ * Each arena keeps a fresh mark, above which the heap has only ever held
+ * the boundary tags and links of the free block at its end. `calloc`
+ * clears those and whatever lies below the mark, but leaves the rest of a
+ * block carved from newly grown heap space, and all of a new mapping, as
+ * the zeros the memory system handed out.
+ *
+ * Free blocks larger than the last list class form one more class, kept in
+ * a red-black tree ordered by size and then address. The tree links live
+ * in the block payload, in place of the list links, and give an O(log n)
+ * best fit for large requests however many large free blocks there are.
+ *
+ * Small requests that would waste most of a block's header and padding
+ * are instead served from slabs: allocated blocks holding a slab_size
+ * frame of equal slots, whose free slots are tracked in a bitmap word of
+ * the slab rather than in headers. A second bitmap, one bit per frame of
+ * the heap, tells `free` whether a pointer lies in a slab. One emptied slab
+ * per class is kept for reuse until the fast bins are next consolidated.
+ *
+ * All of this state belongs to an arena. Normally there is one, in the
+ * heap obtained from mem_sbrk. When built with MM_THREAD_SAFE there are
+ * several, each with its own lock and free lists, and every arena after
+ * the first lives in a region of its own obtained from memlib. Threads
+ * are spread over the arenas round-robin, and a block is always freed to
+ * the arena it came from, which is found from its address. A thread that
+ * frees a block of another arena pushes it onto that arena's lock-free
+ * remote free stack, which the arena drains on its next malloc. Each thread
+ * also keeps a small cache (tcache) of recently freed small blocks in
+ * front of its arena. Cached blocks stay marked allocated in the heap, so
+ * a malloc/free pair that hits the cache takes no lock at all.
+ *
+ * Without MM_THREAD_SAFE, fast bins play the same part: small freed blocks
+ * other than mini blocks go onto an exact-size LIFO bin, still marked
+ * allocated, and are handed out again as they are. They are coalesced in
+ * bulk only when a request finds no fit in the free lists, or when the
+ * bins grow past a fast_divisor-th of the heap.
+ *
+ * mm_checkheap walks the whole heap, checking each block against its
+ * neighbors, and then checks that the free lists, the tree, the fast bins
+ * and the slabs hold exactly what the walk found. Built with CHECK_SLICE,
+ * it instead checks the blocks each arena saw touched since the previous
+ * call, and the next slice of a sweep through the heap, so that checking
+ * can stay on at a small cost.
+ *
+ * Each arena also counts its splits, coalesces and heap resizes, and the
+ * free blocks and requests of each size class, which mm_stats sums into a
+ * snapshot. With MM_THREAD_SAFE, a thread counts its requests in its
+ * tcache, and adds them to an arena the next time it holds the arena's
+ * lock, so that a malloc served from the cache still takes no lock.
  *
  *************************************************************************
  *
@@ -20,6 +104,7 @@
  */
 
 #include <assert.h>
+#include <errno.h>
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -28,6 +113,10 @@
 #include <string.h>
 #include <unistd.h>
 
+#ifdef MM_THREAD_SAFE
+#include <pthread.h>
+#endif
+
 #include "memlib.h"
 #include "mm.h"
 
@@ -39,6 +128,13 @@
 #define free mm_free
 #define realloc mm_realloc
 #define calloc mm_calloc
+#define memalign mm_memalign
+#define aligned_alloc mm_aligned_alloc
+#define posix_memalign mm_posix_memalign
+#define free_sized mm_free_sized
+#define malloc_batch mm_malloc_batch
+#define free_batch mm_free_batch
+#define malloc_usable_size mm_malloc_usable_size
 #define memset mem_memset
 #define memcpy mem_memcpy
 #endif /* def DRIVER */
@@ -91,64 +187,491 @@ static const size_t wsize = sizeof(word_t);
 /** @brief Double word size (bytes) */
 static const size_t dsize = 2 * wsize;
 
-/** @brief Minimum block size (bytes) */
+/**
+ * @brief Minimum size of a regular block (bytes)
+ *
+ * A regular free block must hold a header, the two free list links and a
+ * footer. Anything smaller is a mini block.
+ */
 static const size_t min_block_size = 2 * dsize;
 
 /**
- * TODO: explain what chunksize is
+ * @brief Size of a mini block (bytes)
+ *
+ * A mini block holds a header and one word, which is either the payload or
+ * the `next` link of the mini free list.
+ */
+static const size_t mini_block_size = dsize;
+
+/**
+ * @brief Minimum amount by which the heap is extended when no fit is found
+ *        (bytes), and the size of the initial free block
  * (Must be divisible by dsize)
  */
 static const size_t chunksize = (1 << 12);
 
 /**
- * TODO: explain what alloc_mask is
+ * @brief Smallest adjusted request size served by a mapping of its own
+ *        rather than the heap (bytes)
+ *
+ * Such blocks are returned to the memory system as soon as they are freed,
+ * instead of pinning the heap at its largest size. Smaller blocks are
+ * better recycled within the heap, since each mapping rounds up to whole
+ * pages and its memory cannot be reused by other requests.
+ */
+static const size_t huge_threshold = (1 << 18);
+
+/**
+ * @brief Upper bound on the extension chosen by heap_growth_size (bytes)
+ * (Must be divisible by chunksize)
+ */
+static const size_t max_chunksize = (1 << 20);
+
+/**
+ * @brief Heap growth divisor: a heap of n bytes grows by about n / this
+ *        many bytes at a time, bounding the space left unused at the end
+ *        of the heap to that fraction of its size
+ */
+static const size_t growth_divisor = 32;
+
+/**
+ * @brief Size a free block at the end of the heap must reach before the
+ *        heap is trimmed (bytes)
+ */
+static const size_t trim_threshold = (1 << 21);
+
+/**
+ * @brief Size left to the free block at the end of the heap when trimming
+ *        (bytes)
+ *
+ * Keeping as much as the largest heap extension means a heap that shrinks
+ * and regrows by a similar amount does not call mem_sbrk in both
+ * directions every time.
+ * (Must be divisible by dsize and below trim_threshold)
+ */
+static const size_t trim_keep = max_chunksize;
+
+/**
+ * @brief Number of frees in an arena between passes that purge the pages
+ *        of large free blocks
+ *
+ * Each pass starts a new purge epoch and only purges the blocks that were
+ * already free at the previous pass. Pages are thus held for one to two
+ * intervals before the memory system gets them back, and a block that is
+ * reused soon after it is freed is never purged at all.
+ */
+static const size_t purge_interval = (1 << 12);
+
+/** @brief Purge epoch of a large free block whose pages have been purged */
+static const size_t purged_epoch = SIZE_MAX;
+
+/**
+ * @brief Size of a slab frame (bytes)
+ *
+ * A slab is an allocated block whose payload is a frame of this size,
+ * aligned to its size, that holds the payloads of one small size class
+ * side by side, without headers. Frames are small so that the partially
+ * used slab of each class wastes little.
+ */
+static const size_t slab_size = (1 << 10);
+
+/**
+ * @brief Largest payload kept in slabs (bytes)
+ *
+ * A slab of larger slots fits too few of them to make up for its header
+ * and the header of its block.
+ */
+static const size_t slab_max_slot = 64;
+
+#ifndef MM_THREAD_SAFE
+/**
+ * @brief Heap size below which no slabs are made (bytes)
+ *
+ * A small heap would spend too much of its size on slabs that are mostly
+ * empty. The thread-safe build makes no slabs at all.
+ */
+static const size_t slab_min_heap = (1 << 16);
+#endif
+
+/**
+ * @brief Maximum size of the bitmap of slab frames (words)
+ *
+ * This covers 128 MB of heap; slabs are not made above that, so that a
+ * huge heap in sparse mode does not need a huge bitmap.
  */
+static const size_t slab_map_max_words = (1 << 11);
+
+/** @brief Mask for the allocation status bit of a header or footer */
 static const word_t alloc_mask = 0x1;
 
+/** @brief Mask for the allocation status of the previous block in the heap */
+static const word_t prev_alloc_mask = 0x2;
+
+/** @brief Mask for whether the previous block in the heap is a mini block */
+static const word_t prev_mini_mask = 0x4;
+
+/** @brief Mask for whether a block lives in a mapping of its own */
+static const word_t huge_mask = 0x8;
+
 /**
- * TODO: explain what size_mask is
+ * @brief Mask for the block size stored in a header or footer
+ *
+ * Block sizes are multiples of 16, so the low 4 bits are free for flags.
  */
 static const word_t size_mask = ~(word_t)0xF;
 
+/*
+ * Placement policy used by find_fit, selectable at compile time (for
+ * example with `make MMFLAGS=-DFIT_POLICY=0`):
+ *   0: first fit, taking the first block that is large enough
+ *   1: bounded best fit, taking the smallest of the first
+ *      FIT_SEARCH_LIMIT blocks in a list that are large enough
+ *   2: best fit, taking the smallest large enough block in a list
+ */
+#ifndef FIT_POLICY
+#define FIT_POLICY 1
+#endif
+
+#ifndef FIT_SEARCH_LIMIT
+#define FIT_SEARCH_LIMIT 8
+#endif
+
+/** @brief Placement policies for find_fit */
+typedef enum { FIRST_FIT = 0, BOUNDED_BEST_FIT = 1, BEST_FIT = 2 } fit_policy_t;
+
+/** @brief The placement policy selected at compile time */
+static const fit_policy_t fit_policy = FIT_POLICY;
+
+/** @brief Number of fitting candidates examined by bounded best fit */
+static const size_t fit_search_limit = FIT_SEARCH_LIMIT;
+
+/*
+ * Heap checker mode. With CHECK_SLICE 0, every mm_checkheap call checks the
+ * whole heap. Otherwise a call checks the blocks touched since the previous
+ * call, and the next CHECK_SLICE blocks of a sweep that wraps around at the
+ * end of the heap, so that its cost does not grow with the heap.
+ *
+ * With CHECK_HEAP n > 0, every n-th heap operation of an arena ends with
+ * mm_checkheap even without DEBUG, and the first inconsistency aborts the
+ * program. A check then covers at most the last CHECK_TOUCHED blocks that
+ * were touched. For a canary, build with, for example,
+ * `make MMFLAGS="-DCHECK_HEAP=512 -DCHECK_SLICE=16"`.
+ */
+#ifndef CHECK_SLICE
+#define CHECK_SLICE 0
+#endif
+
+#ifndef CHECK_HEAP
+#define CHECK_HEAP 0
+#endif
+
+/** @brief Number of recently touched blocks kept for incremental checks */
+#define CHECK_TOUCHED 16
+
+/** @brief Blocks swept per incremental heap check, or 0 for full checks */
+static const size_t check_slice = CHECK_SLICE;
+
+/** @brief Heap operations per heap check outside DEBUG builds, or 0 */
+static const size_t check_heap = CHECK_HEAP;
+
+#ifdef SIZE_CLASSES
+/*
+ * The build generates sizeclasses.h with sizeclasses.pl, which fits the
+ * classes to the request sizes of the traces. It defines NUM_SEG_LISTS,
+ * the largest size of each class in seg_class_max, and seg_class_table,
+ * which maps each block size up to the last of these to its class.
+ */
+#include "sizeclasses.h"
+#else
+/**
+ * @brief Number of segregated free lists
+ *
+ * Class 0 holds min_block_size blocks, and class i holds blocks of size in
+ * (2^(i+4), 2^(i+5)]. All larger blocks belong to class NUM_SEG_LISTS,
+ * which is the large block tree rather than a list.
+ */
+#define NUM_SEG_LISTS 8
+
+/** @brief Largest block size of each segregated list (bytes) */
+static const size_t seg_class_max[NUM_SEG_LISTS] = {
+    32, 64, 128, 256, 512, 1024, 2048, 4096,
+};
+#endif
+
+/** @brief Size class index of the large block tree */
+static const size_t tree_index = NUM_SEG_LISTS;
+
+/**
+ * @brief Number of slab size classes
+ *
+ * Class i holds slots of (i + 1) * dsize bytes, up to slab_max_slot.
+ */
+#define NUM_SLAB_CLASSES 4
+
+#ifndef MM_THREAD_SAFE
+/*
+ * Fast bins: freed blocks of min_block_size bytes and of each of the next
+ * FAST_BINS - 1 multiples of dsize wait, still marked allocated, in one
+ * LIFO bin per block size until they are reused or coalesced all at once.
+ */
+#define FAST_BINS 8
+
+/**
+ * @brief Fast bin divisor: once the fast bins of a heap of n bytes hold
+ *        more than n / this many bytes, they are coalesced, so that
+ *        deferred frees never pin more than that fraction of the heap
+ */
+static const size_t fast_divisor = 16;
+#endif
+
+#ifdef MM_THREAD_SAFE
+/*
+ * Per-thread cache: freed blocks of up to TCACHE_BINS * dsize bytes are
+ * cached in one bin per block size, holding up to tcache_fill blocks each.
+ */
+#define TCACHE_BINS 16
+
+/** @brief Maximum number of blocks kept in each per-thread cache bin */
+static const size_t tcache_fill = 8;
+
+/*
+ * Number of arenas, each with its own lock and free lists. The default of
+ * 0 means one per online CPU. Threads are assigned to arenas round-robin.
+ */
+#ifndef NUM_ARENAS
+#define NUM_ARENAS 0
+#endif
+
+/** @brief Upper bound on the number of arenas */
+#define MAX_ARENAS 64
+
+/**
+ * @brief Size of the region reserved for each arena but the first (bytes)
+ *
+ * The first arena uses the main heap. Each other arena lives at the start
+ * of a region of this size obtained from memlib; regions are aligned to
+ * their size, so the arena owning a block is found from its address.
+ */
+static const size_t arena_region_size = (size_t)1 << 30;
+#endif
+
 /** @brief Represents the header and payload of one block in the heap */
 typedef struct block {
     /** @brief Header contains size + allocation flag */
     word_t header;
 
     /**
-     * @brief A pointer to the block payload.
+     * @brief The block payload, or the free list links of a free block.
      *
-     * TODO: feel free to delete this comment once you've read it carefully.
-     * We don't know what the size of the payload will be, so we will declare
-     * it as a zero-length array, which is a GNU compiler extension. This will
-     * allow us to obtain a pointer to the start of the payload. (The similar
-     * standard-C feature of "flexible array members" won't work here because
-     * those are not allowed to be members of a union.)
+     * We don't know what the size of the payload will be, so we declare
+     * it as a zero-length array, which is a GNU compiler extension. It is
+     * aliased through the union with the free list links, which are only
+     * meaningful while the block is free.
      *
-     * WARNING: A zero-length array must be the last element in a struct, so
-     * there should not be any struct fields after it. For this lab, we will
-     * allow you to include a zero-length array in a union, as long as the
-     * union is the last field in its containing struct. However, this is
-     * compiler-specific behavior and should be avoided in general.
-     *
-     * WARNING: DO NOT cast this pointer to/from other types! Instead, you
-     * should use a union to alias this zero-length array with another struct,
-     * in order to store additional types of data in the payload memory.
+     * The footer of a free block cannot be declared here, since its
+     * position depends on the block size; see header_to_footer().
      */
-    char payload[0];
+    union {
+        /**
+         * @brief Free list links, valid only when the block is free.
+         *
+         * Free mini blocks only have room for `next`.
+         */
+        struct {
+            /** @brief Next free block in the same segregated list */
+            struct block *next;
+            /** @brief Previous free block in the same segregated list */
+            struct block *prev;
+        };
+        /** @brief Tree links, valid only for free blocks in the tree */
+        struct {
+            /** @brief Subtree of smaller (or equal, lower) blocks */
+            struct block *left;
+            /** @brief Subtree of larger (or equal, higher) blocks */
+            struct block *right;
+            /** @brief Parent node, or NULL for the root */
+            struct block *parent;
+            /** @brief Node color */
+            bool red;
+            /**
+             * @brief Purge epoch in which the block was inserted, or
+             *        purged_epoch once its pages have been purged
+             */
+            size_t epoch;
+        };
+        /** @brief A pointer to the block payload */
+        char payload[0];
+    };
+} block_t;
 
-    /*
-     * TODO: delete or replace this comment once you've thought about it.
-     * Why can't we declare the block footer here as part of the struct?
-     * Why do we even have footers -- will the code work fine without them?
-     * which functions actually use the data contained in footers?
+/** @brief Header at the start of a slab frame, followed by its slots */
+typedef struct slab {
+    /** @brief Next slab of the same class that has free slots */
+    struct slab *next;
+    /** @brief Previous slab of the same class that has free slots */
+    struct slab *prev;
+    /** @brief Bit i is set if and only if slot i is free */
+    word_t free_slots;
+    /** @brief Size of each slot (bytes) */
+    uint32_t slot_size;
+    /** @brief Number of slots */
+    uint32_t slot_count;
+} slab_t;
+
+/**
+ * @brief Slab bookkeeping of an arena, kept in a block of its heap to
+ *        spare global space
+ */
+typedef struct slab_dir {
+    /** @brief Slabs with free slots, indexed by slab size class */
+    slab_t *partial[NUM_SLAB_CLASSES];
+    /**
+     * @brief A slab with all slots free, kept on no list until a class
+     *        runs out of free slots, or NULL; indexed by slab size class
      */
-} block_t;
+    slab_t *empty[NUM_SLAB_CLASSES];
+    /**
+     * @brief Bit i is set if and only if the i-th slab_size frame of the
+     *        heap holds a slab
+     */
+    word_t *frames;
+    /** @brief Length of `frames` (words) */
+    size_t frame_words;
+    /** @brief Number of slabs in the heap */
+    size_t num_slabs;
+} slab_dir_t;
+
+#ifndef MM_THREAD_SAFE
+/**
+ * @brief Fast bins of an arena, kept in the first block of its heap to
+ *        spare global space
+ */
+typedef struct fast_bins {
+    /** @brief Singly linked freed blocks, indexed by block size */
+    struct block *bins[FAST_BINS];
+    /** @brief Total size of the blocks in the bins (bytes) */
+    size_t bytes;
+} fast_bins_t;
+#endif
+
+/** @brief A heap with its own free lists */
+typedef struct arena {
+#ifdef MM_THREAD_SAFE
+    /** @brief Protects the arena's blocks and free lists */
+    pthread_mutex_t lock;
+    /** @brief The region holding the arena, or NULL for the main heap */
+    mem_region_t *region;
+    /**
+     * @brief Stack of blocks freed by threads of other arenas, linked
+     *        through `next`; pushed without the lock, drained under it
+     */
+    struct block *remote_frees;
+#endif
+    /** @brief Pointer to first block in the heap */
+    block_t *heap_start;
+    /** @brief Heads of the segregated free lists, indexed by size class */
+    block_t *seg_lists[NUM_SEG_LISTS];
+    /** @brief Head of the singly linked list of free mini blocks */
+    block_t *mini_list;
+    /** @brief Root of the red-black tree of large free blocks */
+    block_t *large_tree;
+    /** @brief Number of blocks freed, which also counts purge epochs */
+    size_t frees;
+    /**
+     * @brief Bit i is set if and only if size class i is non-empty, where
+     *        bit tree_index stands for the large block tree
+     */
+    word_t seg_bitmap;
+    /** @brief Slab bookkeeping, or NULL until the first slab is made */
+    slab_dir_t *slabs;
+    /**
+     * @brief Every payload byte at or above this address reads as zero,
+     *        but for the links and footer of the free block ending the heap
+     */
+    char *fresh;
+#ifndef MM_THREAD_SAFE
+    /** @brief Fast bins, or NULL while the heap is being initialized */
+    fast_bins_t *fast;
+#endif
+    /**
+     * @brief Blocks touched since the last incremental heap check, NULL
+     *        where a block has since been merged away
+     */
+    struct block *touched[CHECK_TOUCHED];
+    /** @brief Number of blocks touched since the last heap check */
+    size_t num_touched;
+    /** @brief Next block of the incremental check's sweep, or NULL */
+    struct block *check_cursor;
+    /** @brief Number of heap operations, for CHECK_HEAP */
+    size_t ops;
+    /**
+     * @brief Event counts, requests and free blocks by size class; the
+     *        other fields of mm_stats_t are filled in by mm_stats
+     */
+    mm_stats_t stats;
+} arena_t;
 
 /* Global variables */
 
-/** @brief Pointer to first block in the heap */
-static block_t *heap_start = NULL;
+#ifdef MM_THREAD_SAFE
+/** @brief The arena in the main heap */
+static arena_t main_arena = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/** @brief The arena the calling thread is working on */
+static _Thread_local arena_t *arena = &main_arena;
+#else
+/** @brief The arena in the main heap, which is the only arena */
+static arena_t main_arena;
+
+/** @brief The arena every heap operation works on */
+static arena_t *const arena = &main_arena;
+#endif
+
+/** @brief Number of live huge blocks */
+static size_t huge_blocks;
+
+/** @brief Total size of the mappings of live huge blocks (bytes) */
+static size_t huge_bytes;
+
+#ifdef MM_THREAD_SAFE
+/** @brief Per-thread cache of freed small blocks */
+typedef struct {
+    /** @brief Singly linked cached blocks, indexed by tcache_index */
+    struct block *bins[TCACHE_BINS];
+    /** @brief Number of blocks in each bin */
+    unsigned char counts[TCACHE_BINS];
+    /** @brief True once the thread exit destructor has been armed */
+    bool registered;
+    /** @brief Requests not yet added to the arena stats, by size class */
+    size_t requests[MM_STATS_CLASSES];
+    /** @brief Total of `requests` */
+    size_t pending;
+} tcache_t;
+
+/** @brief Every arena created so far, indexed by arena number */
+static arena_t *arenas[MAX_ARENAS];
+
+/** @brief Number of arenas threads are spread over */
+static size_t arena_count = 1;
+
+/** @brief Arena number handed to the next new thread, modulo arena_count */
+static size_t next_arena = 0;
+
+/** @brief Serializes the creation of arenas */
+static pthread_mutex_t arenas_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** @brief The arena the calling thread allocates from, once assigned */
+static _Thread_local arena_t *thread_arena;
+
+/** @brief Key whose destructor returns a thread's cache on thread exit */
+static pthread_key_t tcache_key;
+
+/** @brief Creates tcache_key exactly once */
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+
+/** @brief The calling thread's cache */
+static _Thread_local tcache_t tcache;
+#endif
 
 /*
  *****************************************************************************
@@ -180,6 +703,16 @@ static size_t max(size_t x, size_t y) {
     return (x > y) ? x : y;
 }
 
+/**
+ * @brief Returns the minimum of two integers.
+ * @param[in] x
+ * @param[in] y
+ * @return `x` if `x < y`, and `y` otherwise.
+ */
+static size_t min(size_t x, size_t y) {
+    return (x < y) ? x : y;
+}
+
 /**
  * @brief Rounds `size` up to next multiple of n
  * @param[in] size
@@ -191,22 +724,45 @@ static size_t round_up(size_t size, size_t n) {
 }
 
 /**
- * @brief Packs the `size` and `alloc` of a block into a word suitable for
- *        use as a packed value.
+ * @brief Computes the block size needed to hold a payload of `size` bytes.
+ *
+ * Allocated blocks carry only a header, and block sizes are multiples of
+ * dsize, so requests of up to one word fit in a mini block.
+ *
+ * @param[in] size The requested payload size
+ * @return The adjusted block size
+ */
+static size_t adjust_size(size_t size) {
+    return round_up(size + wsize, dsize);
+}
+
+/**
+ * @brief Packs the `size`, `alloc`, `prev_alloc` and `prev_mini` of a block
+ *        into a word suitable for use as a packed value.
  *
  * Packed values are used for both headers and footers.
  *
- * The allocation status is packed into the lowest bit of the word.
+ * The allocation status is packed into the lowest bit of the word, the
+ * allocation status of the previous block into the bit above it, and
+ * whether the previous block is a mini block into the bit above that.
  *
  * @param[in] size The size of the block being represented
  * @param[in] alloc True if the block is allocated
+ * @param[in] prev_alloc True if the previous block is allocated
+ * @param[in] prev_mini True if the previous block is a mini block
  * @return The packed value
  */
-static word_t pack(size_t size, bool alloc) {
+static word_t pack(size_t size, bool alloc, bool prev_alloc, bool prev_mini) {
     word_t word = size;
     if (alloc) {
         word |= alloc_mask;
     }
+    if (prev_alloc) {
+        word |= prev_alloc_mask;
+    }
+    if (prev_mini) {
+        word |= prev_mini_mask;
+    }
     return word;
 }
 
@@ -259,11 +815,13 @@ static void *header_to_payload(block_t *block) {
  *        footer.
  * @param[in] block
  * @return A pointer to the block's footer
- * @pre The block must be a valid block, not a boundary tag.
+ * @pre The block must be a valid block, not a boundary tag or mini block.
  */
 static word_t *header_to_footer(block_t *block) {
     dbg_requires(get_size(block) != 0 &&
                  "Called header_to_footer on the epilogue block");
+    dbg_requires(get_size(block) != mini_block_size &&
+                 "Called header_to_footer on a mini block");
     return (word_t *)(block->payload + get_size(block) - dsize);
 }
 
@@ -288,17 +846,17 @@ static block_t *footer_to_header(word_t *footer) {
 }
 
 /**
- * @brief Returns the payload size of a given block.
+ * @brief Returns the payload size of a given allocated block.
  *
- * The payload size is equal to the entire block size minus the sizes of the
- * block's header and footer.
+ * The payload size is equal to the entire block size minus the size of the
+ * block's header, since allocated blocks have no footer.
  *
  * @param[in] block
  * @return The size of the block's payload
  */
 static size_t get_payload_size(block_t *block) {
     size_t asize = get_size(block);
-    return asize - dsize;
+    return asize - wsize;
 }
 
 /**
@@ -322,37 +880,210 @@ static bool get_alloc(block_t *block) {
     return extract_alloc(block->header);
 }
 
+/**
+ * @brief Returns the allocation status of the previous block in the heap.
+ *
+ * This is based on the second-lowest bit of the block's header.
+ *
+ * @param[in] block
+ * @return True if the previous block is allocated
+ */
+static bool get_prev_alloc(block_t *block) {
+    return (bool)(block->header & prev_alloc_mask);
+}
+
+/**
+ * @brief Returns whether the previous block in the heap is a mini block.
+ *
+ * This is based on the third-lowest bit of the block's header.
+ *
+ * @param[in] block
+ * @return True if the previous block is a mini block
+ */
+static bool get_prev_mini(block_t *block) {
+    return (bool)(block->header & prev_mini_mask);
+}
+
+/**
+ * @brief Returns whether a free block needs a footer.
+ *
+ * Mini blocks are too small for a footer; their successor finds them
+ * through its previous-mini bit instead.
+ *
+ * @param[in] size The size of the block
+ * @return True if a free block of `size` bytes has a footer
+ */
+static bool has_footer(size_t size) {
+    return size > mini_block_size;
+}
+
+/**
+ * @brief Extends the heap of the current arena, like mem_sbrk.
+ * @param[in] incr The number of bytes to extend the heap by, or to shrink
+ *                 it by if negative
+ * @return The start of the new area, or (void *)-1 on failure
+ */
+static void *arena_sbrk(intptr_t incr) {
+#ifdef MM_THREAD_SAFE
+    if (arena->region != NULL) {
+        return mem_region_sbrk(arena->region, incr);
+    }
+#endif
+    return mem_sbrk(incr);
+}
+
+/**
+ * @brief Finds the last byte of the current arena's heap.
+ * @return The address of the last byte in the heap
+ */
+static void *arena_heap_hi(void) {
+#ifdef MM_THREAD_SAFE
+    if (arena->region != NULL) {
+        return mem_region_hi(arena->region);
+    }
+#endif
+    return mem_heap_hi();
+}
+
+/**
+ * @brief Returns the size of the current arena's heap.
+ * @return The size of the heap, in bytes
+ */
+static size_t arena_heapsize(void) {
+#ifdef MM_THREAD_SAFE
+    if (arena->region != NULL) {
+        return mem_region_heapsize(arena->region);
+    }
+#endif
+    return mem_heapsize();
+}
+
+/**
+ * @brief Finds where the current arena's heap reads as zero above its
+ *        break, like mem_heap_fresh.
+ * @return The start of the zeroed memory above the break
+ */
+static char *arena_heap_fresh(void) {
+#ifdef MM_THREAD_SAFE
+    if (arena->region != NULL) {
+        return mem_region_fresh(arena->region);
+    }
+#endif
+    return mem_heap_fresh();
+}
+
 /**
  * @brief Writes an epilogue header at the given address.
  *
  * The epilogue header has size 0, and is marked as allocated.
  *
  * @param[out] block The location to write the epilogue header
+ * @param[in] prev_alloc The allocation status of the last block in the heap
  */
-static void write_epilogue(block_t *block) {
+static void write_epilogue(block_t *block, bool prev_alloc) {
     dbg_requires(block != NULL);
-    dbg_requires((char *)block == (char *)mem_heap_hi() - 7);
-    block->header = pack(0, true);
+    dbg_requires((char *)block == (char *)arena_heap_hi() - 7);
+    block->header = pack(0, true, prev_alloc, false);
 }
 
 /**
  * @brief Writes a block starting at the given address.
  *
- * This function writes both a header and footer, where the location of the
- * footer is computed in relation to the header.
+ * This function always writes the header. A footer, whose location is
+ * computed in relation to the header, is only written for free blocks
+ * larger than a mini block.
  *
- * TODO: Are there any preconditions or postconditions?
+ * The caller is responsible for updating the previous-allocated and
+ * previous-mini bits of the following block if they have changed.
  *
  * @param[out] block The location to begin writing the block header
  * @param[in] size The size of the new block
  * @param[in] alloc The allocation status of the new block
+ * @param[in] prev_alloc The allocation status of the previous block
+ * @param[in] prev_mini True if the previous block is a mini block
+ * @pre `size` is a positive multiple of dsize
  */
-static void write_block(block_t *block, size_t size, bool alloc) {
+static void write_block(block_t *block, size_t size, bool alloc,
+                        bool prev_alloc, bool prev_mini) {
     dbg_requires(block != NULL);
     dbg_requires(size > 0);
-    block->header = pack(size, alloc);
-    word_t *footerp = header_to_footer(block);
-    *footerp = pack(size, alloc);
+    block->header = pack(size, alloc, prev_alloc, prev_mini);
+    if (!alloc && has_footer(size)) {
+        word_t *footerp = header_to_footer(block);
+        *footerp = block->header;
+    }
+}
+
+/**
+ * @brief Stores a new header word for a block that may be allocated.
+ *
+ * In a thread-safe build, the owner of an allocated block reads its size
+ * without holding the heap lock (see load_header), while other threads
+ * update its flag bits under the lock. The store is then a relaxed atomic,
+ * so the reader sees either the old or the new word, which have the same
+ * size.
+ *
+ * @param[in] block The block whose header should be updated
+ * @param[in] header The new header word
+ */
+static void store_header(block_t *block, word_t header) {
+#ifdef MM_THREAD_SAFE
+    __atomic_store_n(&block->header, header, __ATOMIC_RELAXED);
+#else
+    block->header = header;
+#endif
+}
+
+/**
+ * @brief Loads the header word of an allocated block without the lock.
+ *
+ * The counterpart of store_header for the owner of the block.
+ *
+ * @param[in] block An allocated block
+ * @return The header word of the block
+ */
+static word_t load_header(block_t *block) {
+#ifdef MM_THREAD_SAFE
+    return __atomic_load_n(&block->header, __ATOMIC_RELAXED);
+#else
+    return block->header;
+#endif
+}
+
+/**
+ * @brief Updates the previous-allocated bit in a block's header.
+ *
+ * The footer of a free block is updated as well, so that it stays an exact
+ * copy of the header. The epilogue may be passed as `block`.
+ *
+ * @param[in] block The block whose header should be updated
+ * @param[in] prev_alloc The new allocation status of the previous block
+ */
+static void write_prev_alloc(block_t *block, bool prev_alloc) {
+    dbg_requires(block != NULL);
+    word_t header = block->header & ~prev_alloc_mask;
+    store_header(block, prev_alloc ? (header | prev_alloc_mask) : header);
+    if (!get_alloc(block) && has_footer(get_size(block))) {
+        *header_to_footer(block) = block->header;
+    }
+}
+
+/**
+ * @brief Updates the previous-mini bit in a block's header.
+ *
+ * The footer of a free block is updated as well, so that it stays an exact
+ * copy of the header. The epilogue may be passed as `block`.
+ *
+ * @param[in] block The block whose header should be updated
+ * @param[in] prev_mini True if the previous block is now a mini block
+ */
+static void write_prev_mini(block_t *block, bool prev_mini) {
+    dbg_requires(block != NULL);
+    word_t header = block->header & ~prev_mini_mask;
+    store_header(block, prev_mini ? (header | prev_mini_mask) : header);
+    if (!get_alloc(block) && has_footer(get_size(block))) {
+        *header_to_footer(block) = block->header;
+    }
 }
 
 /**
@@ -376,6 +1107,7 @@ static block_t *find_next(block_t *block) {
  * @brief Finds the footer of the previous block on the heap.
  * @param[in] block A block in the heap
  * @return The location of the previous block's footer
+ * @pre The previous block is free, so that it actually has a footer
  */
 static word_t *find_prev_footer(block_t *block) {
     // Compute previous footer position as one word before the header
@@ -387,18 +1119,23 @@ static word_t *find_prev_footer(block_t *block) {
  *
  * This is the previous block in the "implicit list" of the heap.
  *
- * The position of the previous block is found by reading the previous
+ * If the previous block is a mini block, it starts mini_block_size bytes
+ * before this one. Otherwise its position is found by reading the previous
  * block's footer to determine its size, then calculating the start of the
  * previous block based on its size.
  *
  * @param[in] block A block in the heap
  * @return The previous consecutive block in the heap.
- * @pre The block is not the prologue
+ * @pre The block is not the prologue, and the previous block is free
  */
 static block_t *find_prev(block_t *block) {
     dbg_requires(block != NULL);
     dbg_requires(get_size(block) != 0 &&
                  "Called find_prev on the first block in the heap");
+    dbg_requires(!get_prev_alloc(block));
+    if (get_prev_mini(block)) {
+        return (block_t *)((char *)block - mini_block_size);
+    }
     word_t *footerp = find_prev_footer(block);
     return footer_to_header(footerp);
 }
@@ -412,303 +1149,2940 @@ static block_t *find_prev(block_t *block) {
 /******** The remaining content below are helper and debug routines ********/
 
 /**
- * @brief
+ * @brief Finds the segregated list size class of a block size.
  *
- * <What does this function do?>
- * <What are the function's arguments?>
- * <What is the function's return value?>
- * <Are there any preconditions or postconditions?>
+ * Class i holds sizes up to seg_class_max[i]. With the classes generated
+ * into sizeclasses.h, the class is looked up in seg_class_table; otherwise
+ * class i holds sizes in (2^(i+4), 2^(i+5)], and is computed from the
+ * position of the highest set bit of `asize - 1`. Either way this takes
+ * constant time. Mini blocks map to class 0, which is where a mini request
+ * continues its search once the mini list is empty, and blocks too large
+ * for the last list map to tree_index.
  *
- * @param[in] block
- * @return
+ * @param[in] asize The size of a block, including its overhead
+ * @return The index of the free list that holds blocks of size `asize`
+ * @pre `asize >= mini_block_size`
  */
-static block_t *coalesce_block(block_t *block) {
-    /*
-     * TODO: delete or replace this comment once you're done.
-     *
-     * Before you start, it will be helpful to review the "Dynamic Memory
-     * Allocation: Basic" lecture, and especially the four coalescing
-     * cases that are described.
-     *
-     * The actual content of the function will probably involve a call to
-     * find_prev(), and multiple calls to write_block(). For examples of how
-     * to use write_block(), take a look at split_block().
-     *
-     * Please do not reference code from prior semesters for this, including
-     * old versions of the 213 website. We also discourage you from looking
-     * at the malloc code in CS:APP and K&R, which make heavy use of macros
-     * and which we no longer consider to be good style.
+static size_t find_seg_index(size_t asize) {
+    dbg_requires(asize >= mini_block_size);
+
+    if (asize > seg_class_max[NUM_SEG_LISTS - 1]) {
+        return tree_index;
+    }
+#ifdef SIZE_CLASSES
+    return seg_class_table[asize / dsize];
+#else
+    if (asize <= min_block_size) {
+        return 0;
+    }
+    // ceil(log2(asize)) - log2(min_block_size)
+    return (size_t)(64 - __builtin_clzl(asize - 1)) - 5;
+#endif
+}
+
+/**
+ * @brief Returns whether a tree node is red.
+ * @param[in] node A tree node, or NULL for a (black) leaf
+ * @return True if `node` is a red node
+ */
+static bool tree_is_red(block_t *node) {
+    return node != NULL && node->red;
+}
+
+/**
+ * @brief Orders two large free blocks by size, then by address.
+ * @param[in] a
+ * @param[in] b
+ * @return True if `a` sorts before `b` in the large block tree
+ */
+static bool tree_less(block_t *a, block_t *b) {
+    size_t size_a = get_size(a);
+    size_t size_b = get_size(b);
+    return size_a < size_b || (size_a == size_b && a < b);
+}
+
+/**
+ * @brief Replaces the subtree rooted at `old` with the one rooted at `node`
+ *        in the eyes of `old`'s parent.
+ * @param[in] old A node in the tree
+ * @param[in] node The new subtree root, or NULL
+ */
+static void tree_replace_child(block_t *old, block_t *node) {
+    block_t *parent = old->parent;
+    if (parent == NULL) {
+        arena->large_tree = node;
+    } else if (parent->left == old) {
+        parent->left = node;
+    } else {
+        parent->right = node;
+    }
+    if (node != NULL) {
+        node->parent = parent;
+    }
+}
+
+/**
+ * @brief Rotates the tree left around `node`.
+ * @param[in] node A node with a right child
+ */
+static void tree_rotate_left(block_t *node) {
+    block_t *child = node->right;
+    node->right = child->left;
+    if (child->left != NULL) {
+        child->left->parent = node;
+    }
+    tree_replace_child(node, child);
+    child->left = node;
+    node->parent = child;
+}
+
+/**
+ * @brief Rotates the tree right around `node`.
+ * @param[in] node A node with a left child
+ */
+static void tree_rotate_right(block_t *node) {
+    block_t *child = node->left;
+    node->left = child->right;
+    if (child->right != NULL) {
+        child->right->parent = node;
+    }
+    tree_replace_child(node, child);
+    child->right = node;
+    node->parent = child;
+}
+
+/**
+ * @brief Inserts a free block into the large block tree.
+ *
+ * The block is added as a red leaf, and red-red violations are repaired
+ * by recoloring and at most two rotations.
+ *
+ * @param[in] node A free block that is not on any free list
+ */
+static void tree_insert(block_t *node) {
+    block_t *parent = NULL;
+    block_t **link = &arena->large_tree;
+    while (*link != NULL) {
+        parent = *link;
+        link = tree_less(node, parent) ? &parent->left : &parent->right;
+    }
+    node->left = NULL;
+    node->right = NULL;
+    node->parent = parent;
+    node->red = true;
+    *link = node;
+
+    // The root is black, so a red parent always has a parent itself. Each
+    // iteration either moves the violation two levels up or fixes it with
+    // rotations, after which the subtree root is black.
+    while (tree_is_red(parent = node->parent)) {
+        block_t *grandparent = parent->parent;
+        if (parent == grandparent->left) {
+            block_t *uncle = grandparent->right;
+            if (tree_is_red(uncle)) {
+                parent->red = false;
+                uncle->red = false;
+                grandparent->red = true;
+                node = grandparent;
+                continue;
+            }
+            if (node == parent->right) {
+                tree_rotate_left(parent);
+                parent = node;
+            }
+            parent->red = false;
+            grandparent->red = true;
+            tree_rotate_right(grandparent);
+            break;
+        } else {
+            block_t *uncle = grandparent->left;
+            if (tree_is_red(uncle)) {
+                parent->red = false;
+                uncle->red = false;
+                grandparent->red = true;
+                node = grandparent;
+                continue;
+            }
+            if (node == parent->left) {
+                tree_rotate_right(parent);
+                parent = node;
+            }
+            parent->red = false;
+            grandparent->red = true;
+            tree_rotate_left(grandparent);
+            break;
+        }
+    }
+    arena->large_tree->red = false;
+}
+
+/**
+ * @brief Restores the red-black properties after a black node was removed.
+ *
+ * @param[in] node The node that took the removed node's place, or NULL
+ * @param[in] parent The parent of that position
+ */
+static void tree_remove_fixup(block_t *node, block_t *parent) {
+    while (node != arena->large_tree && !tree_is_red(node)) {
+        // The removed side was short one black node, so the sibling exists
+        if (node == parent->left) {
+            block_t *sibling = parent->right;
+            if (sibling->red) {
+                sibling->red = false;
+                parent->red = true;
+                tree_rotate_left(parent);
+                sibling = parent->right;
+            }
+            if (!tree_is_red(sibling->left) && !tree_is_red(sibling->right)) {
+                sibling->red = true;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+            if (!tree_is_red(sibling->right)) {
+                sibling->left->red = false;
+                sibling->red = true;
+                tree_rotate_right(sibling);
+                sibling = parent->right;
+            }
+            sibling->red = parent->red;
+            parent->red = false;
+            sibling->right->red = false;
+            tree_rotate_left(parent);
+        } else {
+            block_t *sibling = parent->left;
+            if (sibling->red) {
+                sibling->red = false;
+                parent->red = true;
+                tree_rotate_right(parent);
+                sibling = parent->left;
+            }
+            if (!tree_is_red(sibling->left) && !tree_is_red(sibling->right)) {
+                sibling->red = true;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+            if (!tree_is_red(sibling->left)) {
+                sibling->right->red = false;
+                sibling->red = true;
+                tree_rotate_left(sibling);
+                sibling = parent->left;
+            }
+            sibling->red = parent->red;
+            parent->red = false;
+            sibling->left->red = false;
+            tree_rotate_right(parent);
+        }
+        node = arena->large_tree;
+    }
+    if (node != NULL) {
+        node->red = false;
+    }
+}
+
+/**
+ * @brief Removes a free block from the large block tree.
+ *
+ * A node with two children is replaced by its in-order successor, so the
+ * node actually unlinked from its position has at most one child.
+ *
+ * @param[in] node A free block currently in the tree
+ */
+static void tree_remove(block_t *node) {
+    block_t *child;
+    block_t *parent;
+    bool removed_red = node->red;
+
+    if (node->left == NULL || node->right == NULL) {
+        child = (node->left != NULL) ? node->left : node->right;
+        parent = node->parent;
+        tree_replace_child(node, child);
+    } else {
+        block_t *successor = node->right;
+        while (successor->left != NULL) {
+            successor = successor->left;
+        }
+        removed_red = successor->red;
+        child = successor->right;
+        if (successor->parent == node) {
+            parent = successor;
+        } else {
+            parent = successor->parent;
+            tree_replace_child(successor, child);
+            successor->right = node->right;
+            successor->right->parent = successor;
+        }
+        tree_replace_child(node, successor);
+        successor->left = node->left;
+        successor->left->parent = successor;
+        successor->red = node->red;
+    }
+
+    if (!removed_red) {
+        tree_remove_fixup(child, parent);
+    }
+}
+
+/**
+ * @brief Finds the best fit for a request in the large block tree.
+ *
+ * @param[in] asize The adjusted size of the request
+ * @return The smallest block of at least `asize` bytes, preferring the
+ *         lowest address among equal sizes, or NULL if none exists
+ */
+static block_t *tree_find_fit(size_t asize) {
+    block_t *fit = NULL;
+    block_t *node = arena->large_tree;
+    while (node != NULL) {
+        if (get_size(node) >= asize) {
+            fit = node;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    return fit;
+}
+
+/**
+ * @brief Records a block whose header or links just changed, for the next
+ *        incremental heap check.
+ *
+ * Only the last CHECK_TOUCHED blocks are kept; older ones are left to the
+ * sweep.
+ *
+ * @param[in] block A block in the current arena's heap
+ */
+static void touch_block(block_t *block) {
+    if (check_slice > 0) {
+        arena->touched[arena->num_touched++ % CHECK_TOUCHED] = block;
+    }
+}
+
+/**
+ * @brief Forgets the blocks that an incremental heap check remembers but
+ *        that have just been merged into `block`.
+ *
+ * Their headers now lie inside the payload of `block`, and would read as
+ * garbage. A sweep stopped inside `block` resumes at `block` itself.
+ *
+ * @param[in] block A block that has just absorbed the blocks after it
+ */
+static void forget_interior(block_t *block) {
+    if (check_slice == 0) {
+        return;
+    }
+    block_t *end = find_next(block);
+    size_t touched = min(arena->num_touched, CHECK_TOUCHED);
+    for (size_t i = 0; i < touched; i++) {
+        if (arena->touched[i] > block && arena->touched[i] < end) {
+            arena->touched[i] = NULL;
+        }
+    }
+    if (arena->check_cursor > block && arena->check_cursor < end) {
+        arena->check_cursor = block;
+    }
+}
+
+/**
+ * @brief Checks the heap after every check_heap-th operation, aborting if
+ *        it is inconsistent.
+ * @param[in] line The line the check was called from
+ * @pre The current arena's lock is held, if any
+ */
+static void audit_heap(int line) {
+    if (check_heap == 0 || ++arena->ops < check_heap) {
+        return;
+    }
+    arena->ops = 0;
+    if (!mm_checkheap(line)) {
+        abort();
+    }
+}
+
+/**
+ * @brief Returns the size class of a block in mm_stats.
+ *
+ * Class 0 holds mini blocks, class index + 1 the blocks of segregated list
+ * `index`, and the last class the blocks of the large block tree.
+ *
+ * @param[in] asize The size of a block, including its overhead
+ * @return The index into mm_stats_t's `classes`
+ */
+static size_t stats_class(size_t asize) {
+    if (asize == mini_block_size) {
+        return 0;
+    }
+    return find_seg_index(asize) + 1;
+}
+
+/**
+ * @brief Counts a block joining (or, for `delta == -1`, leaving) the
+ *        current arena's free lists.
+ * @param[in] asize The size of the block
+ * @param[in] delta 1 or -1
+ */
+static void count_free(size_t asize, int delta) {
+    mm_class_stats_t *class = &arena->stats.classes[stats_class(asize)];
+    class->free_blocks += (size_t)delta;
+    class->free_bytes += (size_t)delta * asize;
+}
+
+/**
+ * @brief Counts `n` allocation requests of `asize` bytes each.
+ *
+ * In a thread-safe build, the count waits in the thread's cache until the
+ * thread next holds an arena's lock, so that requests served without the
+ * lock stay lock-free.
+ *
+ * @param[in] asize The adjusted size of the requests
+ * @param[in] n The number of requests
+ */
+static void count_request(size_t asize, size_t n) {
+#ifdef MM_THREAD_SAFE
+    tcache.requests[stats_class(asize)] += n;
+    tcache.pending += n;
+#else
+    arena->stats.classes[stats_class(asize)].requests += n;
+#endif
+}
+
+#ifdef MM_THREAD_SAFE
+/**
+ * @brief Adds the requests counted by the calling thread to the stats of
+ *        the current arena.
+ * @pre The current arena's lock is held
+ */
+static void flush_requests(void) {
+    if (tcache.pending == 0) {
+        return;
+    }
+    for (size_t i = 0; i < MM_STATS_CLASSES; i++) {
+        arena->stats.classes[i].requests += tcache.requests[i];
+        tcache.requests[i] = 0;
+    }
+    tcache.pending = 0;
+}
+#endif
+
+/**
+ * @brief Pushes a free block onto the front of its segregated list.
+ *
+ * Mini blocks go onto the mini list, which only uses the `next` link, and
+ * large blocks are inserted into the large block tree.
+ *
+ * @param[in] block A free block that is not on any free list
+ * @pre The block is marked free and its header and footer are written
+ */
+static void insert_free_block(block_t *block) {
+    dbg_requires(!get_alloc(block));
+    touch_block(block);
+    count_free(get_size(block), 1);
+
+    if (get_size(block) == mini_block_size) {
+        block->next = arena->mini_list;
+        arena->mini_list = block;
+        return;
+    }
+
+    size_t index = find_seg_index(get_size(block));
+    if (index == tree_index) {
+        block->epoch = arena->frees / purge_interval;
+        tree_insert(block);
+        arena->seg_bitmap |= (word_t)1 << tree_index;
+        return;
+    }
+
+    block_t *head = arena->seg_lists[index];
+
+    block->prev = NULL;
+    block->next = head;
+    if (head != NULL) {
+        head->prev = block;
+    }
+    arena->seg_lists[index] = block;
+    arena->seg_bitmap |= (word_t)1 << index;
+}
+
+/**
+ * @brief Unlinks a free mini block from the mini list.
+ *
+ * The mini list is singly linked, so this walks the list to find the
+ * predecessor of `block`. Mini blocks are usually taken from the front of
+ * the list by malloc, in which case this is constant time.
+ *
+ * @param[in] block A free mini block currently on the mini list
+ */
+static void remove_mini_block(block_t *block) {
+    dbg_requires(get_size(block) == mini_block_size);
+
+    if (arena->mini_list == block) {
+        arena->mini_list = block->next;
+        return;
+    }
+    block_t *prev = arena->mini_list;
+    while (prev->next != block) {
+        dbg_assert(prev->next != NULL && "Mini block not on the mini list");
+        prev = prev->next;
+    }
+    prev->next = block->next;
+}
+
+/**
+ * @brief Unlinks a free block from its segregated list.
+ *
+ * The block size must not have changed since the block was inserted, as
+ * the size determines which list head may need to be updated.
+ *
+ * @param[in] block A free block currently on a free list
+ */
+static void remove_free_block(block_t *block) {
+    dbg_requires(!get_alloc(block));
+    count_free(get_size(block), -1);
+
+    if (get_size(block) == mini_block_size) {
+        remove_mini_block(block);
+        return;
+    }
+
+    size_t index = find_seg_index(get_size(block));
+    if (index == tree_index) {
+        tree_remove(block);
+        if (arena->large_tree == NULL) {
+            arena->seg_bitmap &= ~((word_t)1 << tree_index);
+        }
+        return;
+    }
+
+    if (block->prev != NULL) {
+        block->prev->next = block->next;
+    } else {
+        arena->seg_lists[index] = block->next;
+        if (block->next == NULL) {
+            arena->seg_bitmap &= ~((word_t)1 << index);
+        }
+    }
+    if (block->next != NULL) {
+        block->next->prev = block->prev;
+    }
+}
+
+/**
+ * @brief Merges a free block with any free neighbors in the heap.
+ *
+ * The four boundary-tag cases are handled in constant time: the status of
+ * the previous block comes from `block`'s previous-allocated bit, and only
+ * when it is free is the block located, through its previous-mini bit or
+ * its footer. The next block is found through the size in `block`'s
+ * header. Free neighbors are unlinked from their free lists before their
+ * headers are overwritten.
+ * The prologue and epilogue are marked allocated, so they are never merged.
+ *
+ * @param[in] block A free block that is not on any free list
+ * @return The merged free block, which is not on any free list
+ * @post The returned block has no free neighbors
+ */
+static block_t *coalesce_block(block_t *block) {
+    dbg_requires(!get_alloc(block));
+
+    bool prev_alloc = get_prev_alloc(block);
+    block_t *block_next = find_next(block);
+    bool next_alloc = get_alloc(block_next);
+    size_t size = get_size(block);
+
+    if (prev_alloc && next_alloc) {
+        // Case 1: both neighbors allocated, nothing to merge
+        return block;
+    }
+
+    if (!next_alloc) {
+        // Cases 2 and 4: absorb the next block
+        remove_free_block(block_next);
+        size += get_size(block_next);
+    }
+
+    if (!prev_alloc) {
+        // Cases 3 and 4: merge into the previous block
+        block_t *block_prev = find_prev(block);
+        remove_free_block(block_prev);
+        size += get_size(block_prev);
+        block = block_prev;
+    }
+
+    arena->stats.coalesces++;
+
+    // The block before a free block is always allocated, and the merged
+    // block is never a mini block
+    write_block(block, size, false, true, get_prev_mini(block));
+    write_prev_mini(find_next(block), false);
+    forget_interior(block);
+
+    dbg_ensures(!get_alloc(block));
+    return block;
+}
+
+/**
+ * @brief Extends the heap with a new free block.
+ *
+ * The new block overwrites the old epilogue header, a new epilogue is
+ * written after it, and the block is placed on its free list.
+ *
+ * @param[in] size The minimum number of bytes to extend the heap by
+ * @return The new free block, or NULL if the heap could not be extended
+ */
+static block_t *extend_heap(size_t size) {
+    void *bp;
+    char *zero = arena_heap_fresh();
+
+    // Allocate an even number of words to maintain alignment
+    size = round_up(size, dsize);
+    if ((bp = arena_sbrk((intptr_t)size)) == (void *)-1) {
+        return NULL;
+    }
+    arena->stats.heap_extends++;
+
+    // Space the memory system had handed out before is not fresh
+    if (zero > (char *)bp && zero > arena->fresh) {
+        arena->fresh = zero;
+    }
+
+    /*
+     * bp is the old end of the heap, one word past the old epilogue
+     * header. The new block starts at that header, so it spans the old
+     * epilogue and all but the last word of the new space, which becomes
+     * the new epilogue: the block has exactly `size` bytes.
      */
+
+    // Initialize free block header/footer
+    block_t *block = payload_to_header(bp);
+    // The old epilogue header remembers whether the last block is allocated
+    write_block(block, size, false, get_prev_alloc(block),
+                get_prev_mini(block));
+
+    // Create new epilogue header
+    block_t *block_next = find_next(block);
+    write_epilogue(block_next, false);
+
+    // Coalesce in case the previous block was free
+    block_t *merged = coalesce_block(block);
+    if (merged != block) {
+        // Clear the old footer and epilogue, now inside the block, so that
+        // fresh space keeps reading as zero
+        memset((char *)bp - dsize, 0, dsize);
+    }
+    insert_free_block(merged);
+
+    return merged;
+}
+
+/**
+ * @brief Gives back most of a large free block at the end of the heap.
+ *
+ * If `block` is the last block of the heap and has reached trim_threshold
+ * bytes, it is cut down to trim_keep bytes, the heap is shrunk by the
+ * difference, and the epilogue is rewritten at the new end of the heap.
+ * Any other block is left alone.
+ *
+ * @param[in] block A free block that is not on any free list
+ * @return `block`, which is still not on any free list
+ */
+static block_t *trim_heap(block_t *block) {
+    dbg_requires(!get_alloc(block));
+
+    size_t size = get_size(block);
+    if (size < trim_threshold || get_size(find_next(block)) != 0) {
+        return block;
+    }
+    if (arena_sbrk(-(intptr_t)(size - trim_keep)) == (void *)-1) {
+        return block;
+    }
+    arena->stats.heap_trims++;
+
+    write_block(block, trim_keep, false, get_prev_alloc(block),
+                get_prev_mini(block));
+    write_epilogue(find_next(block), false);
     return block;
 }
 
 /**
- * @brief
+ * @brief Purges the pages of large free blocks that have stayed free for a
+ *        whole purge epoch.
+ *
+ * The pages lying wholly between a block's tree links and its footer are
+ * handed to mem_purge, which releases them to the memory system while
+ * leaving them mapped. The boundary tags and links stay intact, so the
+ * block remains an ordinary free block, and the pages come back as soon
+ * as a later allocation writes to them.
+ *
+ * @param[in] node The root of a subtree of the large block tree, or NULL
+ * @param[in] epoch The purge epoch that has just begun
+ * @pre `epoch > 0`
+ */
+static void purge_tree(block_t *node, size_t epoch) {
+    if (node == NULL) {
+        return;
+    }
+    if (node->epoch < epoch - 1) {
+        char *lo = (char *)node + sizeof(block_t);
+        char *hi = (char *)header_to_footer(node);
+        mem_purge(lo, (size_t)(hi - lo));
+        node->epoch = purged_epoch;
+        arena->stats.purges++;
+    }
+    purge_tree(node->left, epoch);
+    purge_tree(node->right, epoch);
+}
+
+/**
+ * @brief Chooses how far to extend the heap when no fit for `asize` exists.
+ *
+ * A free block at the end of the heap is merged with the extension by
+ * extend_heap, so only the bytes it lacks are requested. The extension is
+ * at least chunksize and grows with the heap, to about 1/growth_divisor of
+ * its current size, so that a heap growing to hundreds of megabytes does
+ * not need a mem_sbrk call for every few kilobytes. Capping it at
+ * max_chunksize, and at the same fraction of the heap, bounds the space
+ * left unused at the end of a workload.
+ *
+ * @param[in] asize The adjusted size of a request that did not fit
+ * @return The number of bytes to pass to extend_heap
+ */
+static size_t heap_growth_size(size_t asize) {
+    block_t *epilogue = (block_t *)((char *)arena_heap_hi() - 7);
+    size_t tail_size = 0;
+    if (!get_prev_alloc(epilogue)) {
+        tail_size = get_prev_mini(epilogue)
+                        ? mini_block_size
+                        : extract_size(*find_prev_footer(epilogue));
+    }
+    // The tail block would have been found by find_fit if it were big enough
+    dbg_assert(tail_size < asize);
+
+    size_t growth = round_up(arena_heapsize() / growth_divisor, chunksize);
+    growth = (growth < max_chunksize) ? growth : max_chunksize;
+    return max(asize - tail_size, max(growth, chunksize));
+}
+
+/**
+ * @brief Splits an allocated block, returning the tail to a free list.
+ *
+ * If the block is at least min_block_size bytes larger than `asize` (or a
+ * mini block larger, for a mini request), it is shrunk to `asize` bytes and
+ * the remainder becomes a new free block, which is merged with the next
+ * block if that is free. Otherwise the block is left untouched.
+ *
+ * @param[in] block An allocated block that is not on any free list
+ * @param[in] asize The adjusted size the block needs to keep
+ * @pre `asize <= get_size(block)`
+ */
+static void split_block(block_t *block, size_t asize) {
+    dbg_requires(get_alloc(block));
+    dbg_requires(asize <= get_size(block));
+
+    size_t block_size = get_size(block);
+    size_t next_size = block_size - asize;
+
+    // A mini remainder is only split off for mini requests. The mini list
+    // is singly linked, so flooding it with the remainders of larger
+    // requests would make unlinking them during coalescing expensive.
+    if (next_size >= min_block_size ||
+        (next_size == mini_block_size && asize == mini_block_size)) {
+        block_t *block_next;
+        arena->stats.splits++;
+        write_block(block, asize, true, get_prev_alloc(block),
+                    get_prev_mini(block));
+
+        block_next = find_next(block);
+        write_block(block_next, next_size, false, true,
+                    asize == mini_block_size);
+
+        block_t *block_after = find_next(block_next);
+        write_prev_alloc(block_after, false);
+        write_prev_mini(block_after, next_size == mini_block_size);
+
+        // Only a block shrunk by realloc can have a free successor
+        block_next = coalesce_block(block_next);
+        insert_free_block(block_next);
+    }
+
+    dbg_ensures(get_alloc(block));
+}
+
+/**
+ * @brief Searches one segregated list according to fit_policy.
+ *
+ * First fit returns the first block of at least `asize` bytes. Best fit
+ * returns the smallest such block, stopping early on an exact fit, and
+ * bounded best fit additionally stops after fit_search_limit candidates.
+ *
+ * @param[in] head The first block of a segregated list
+ * @param[in] asize The adjusted size of the request
+ * @return A free block of at least `asize` bytes, or NULL if none exists
+ */
+static block_t *search_seg_list(block_t *head, size_t asize) {
+    block_t *best = NULL;
+    size_t best_size = 0;
+    size_t candidates = 0;
+
+    for (block_t *block = head; block != NULL; block = block->next) {
+        size_t size = get_size(block);
+        if (size < asize) {
+            continue;
+        }
+        if (fit_policy == FIRST_FIT || size == asize) {
+            return block;
+        }
+        if (best == NULL || size < best_size) {
+            best = block;
+            best_size = size;
+        }
+        candidates++;
+        if (fit_policy == BOUNDED_BEST_FIT && candidates >= fit_search_limit) {
+            break;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Finds a free block that can hold `asize` bytes.
+ *
+ * Mini requests are served from the front of the mini list when possible.
+ * Otherwise the list for the size class of `asize` is searched first, since
+ * it may contain blocks that are too small. Every block in a larger class
+ * fits, so the search then moves to the first non-empty larger class,
+ * located through seg_bitmap. Within a list, fit_policy decides which
+ * block is chosen; the large block tree always yields the best fit.
+ *
+ * @param[in] asize The adjusted size of the request
+ * @return A free block of at least `asize` bytes, or NULL if none exists
+ */
+static block_t *find_fit(size_t asize) {
+    if (asize == mini_block_size && arena->mini_list != NULL) {
+        return arena->mini_list;
+    }
+
+    size_t index = find_seg_index(asize);
+    if (index == tree_index) {
+        return tree_find_fit(asize);
+    }
+    block_t *block = search_seg_list(arena->seg_lists[index], asize);
+    if (block != NULL) {
+        return block;
+    }
+
+    // Classes above index, which may include the large block tree
+    word_t larger = arena->seg_bitmap & (~(word_t)1 << index);
+    if (larger == 0) {
+        return NULL; // no fit found
+    }
+    size_t larger_index = (size_t)__builtin_ctzl(larger);
+    if (larger_index == tree_index) {
+        return tree_find_fit(asize);
+    }
+    return search_seg_list(arena->seg_lists[larger_index], asize);
+}
+
+/**
+ * @brief Moves the current arena's fresh mark past a block just allocated,
+ *        whose payload the caller is about to write.
+ *
+ * The mark also passes the header and links of the next block. Were that
+ * a free block at the end of the heap, freeing `block` would merge them
+ * into the payload of a larger free block.
+ *
+ * @param[in] block An allocated block
+ */
+static void claim_fresh(block_t *block) {
+    char *end = (char *)find_next(block) + sizeof(block_t);
+    if (end > arena->fresh) {
+        arena->fresh = end;
+    }
+}
+
+/**
+ * @brief Grows an allocated block in place into a free successor.
+ *
+ * If the next block in the heap is free and the two blocks together hold
+ * at least `asize` bytes, the next block is absorbed and any excess is
+ * split off again. If they are too small but end the heap, the heap is
+ * first extended by exactly the missing amount, so a block that keeps
+ * growing at the end of the heap never needs a second copy of itself.
+ * The payload of `block` is not moved.
+ *
+ * @param[in] block An allocated block
+ * @param[in] asize The adjusted size the block needs to grow to
+ * @return True if the block now holds at least `asize` bytes
+ * @pre `asize > get_size(block)`
+ */
+static bool grow_block(block_t *block, size_t asize) {
+    dbg_requires(get_alloc(block));
+    dbg_requires(asize > get_size(block));
+
+    block_t *block_next = find_next(block);
+    size_t size = get_size(block);
+    block_t *block_end = block_next;
+    if (!get_alloc(block_next)) {
+        size += get_size(block_next);
+        block_end = find_next(block_next);
+    }
+
+    if (size < asize) {
+        // Only a block at the end of the heap can grow past its neighbors
+        if (get_size(block_end) != 0) {
+            return false;
+        }
+        // The new space is merged with a free successor, if there is one
+        if (extend_heap(asize - size) == NULL) {
+            return false;
+        }
+        block_next = find_next(block);
+        size = get_size(block) + get_size(block_next);
+    } else if (get_alloc(block_next)) {
+        return false;
+    }
+
+    dbg_assert(!get_alloc(block_next));
+    remove_free_block(block_next);
+    arena->stats.coalesces++;
+    write_block(block, size, true, get_prev_alloc(block),
+                get_prev_mini(block));
+    forget_interior(block);
+
+    // The merged block is allocated and never a mini block
+    block_t *block_after = find_next(block);
+    write_prev_alloc(block_after, true);
+    write_prev_mini(block_after, false);
+
+    split_block(block, asize);
+    claim_fresh(block);
+    touch_block(block);
+    return true;
+}
+
+/**
+ * @brief Returns a run of consecutive allocated blocks to the free lists.
+ *
+ * The run becomes a single free block before it is coalesced with its
+ * neighbors, so freeing it costs no more than freeing one block.
+ *
+ * @param[in] block The first block of the run
+ * @param[in] size The total size of the blocks in the run
+ * @pre The current arena's lock is held, if any
+ */
+static void free_run(block_t *block, size_t size) {
+    // The block should be marked as allocated
+    dbg_assert(get_alloc(block));
+    bool merged = (size != get_size(block));
+
+    // Mark the run as one free block
+    write_block(block, size, false, get_prev_alloc(block),
+                get_prev_mini(block));
+    block_t *block_next = find_next(block);
+    write_prev_alloc(block_next, false);
+    if (merged) {
+        // A run of several blocks is never a mini block
+        write_prev_mini(block_next, false);
+        forget_interior(block);
+    }
+
+    // Try to coalesce the block with its neighbors, then give back the end
+    // of the heap if it has become a large free block
+    block = trim_heap(coalesce_block(block));
+    insert_free_block(block);
+
+    // Start a new purge epoch every purge_interval frees
+    arena->frees++;
+    if (arena->frees % purge_interval == 0) {
+        purge_tree(arena->large_tree, arena->frees / purge_interval);
+    }
+}
+
+/**
+ * @brief Returns an allocated block to the free lists.
+ * @param[in] block An allocated block
+ * @pre The current arena's lock is held, if any
+ */
+static void free_block(block_t *block) {
+    free_run(block, get_size(block));
+}
+
+/**
+ * @brief Finds the slab frame bitmap index of an address.
+ * @param[in] addr An address in the heap
+ * @return The number of slab_size frames between the frame of the start of
+ *         the heap and that of `addr`
+ */
+static size_t slab_frame_index(const void *addr) {
+    uintptr_t base = (uintptr_t)arena->heap_start & ~(uintptr_t)(slab_size - 1);
+    return ((uintptr_t)addr - base) / slab_size;
+}
+
+/**
+ * @brief Returns a slab that is on no slab list to the heap.
+ * @param[in] slab A slab whose slots are all free
+ */
+static void release_slab(slab_t *slab) {
+    slab_dir_t *dir = arena->slabs;
+    size_t index = slab_frame_index(slab);
+    dir->frames[index / 64] &= ~((word_t)1 << (index % 64));
+    dir->num_slabs--;
+    free_block(payload_to_header(slab));
+}
+
+/**
+ * @brief Returns the empty slab kept for each slab size class to the heap.
+ *
+ * Once no slab is left, the frame bitmap goes too, since it would only
+ * split the free space it lies in.
+ *
+ * @return True if any slab was returned
+ */
+static bool release_empty_slabs(void) {
+    slab_dir_t *dir = arena->slabs;
+    bool released = false;
+    if (dir == NULL) {
+        return false;
+    }
+    for (size_t class = 0; class < NUM_SLAB_CLASSES; class++) {
+        if (dir->empty[class] != NULL) {
+            release_slab(dir->empty[class]);
+            dir->empty[class] = NULL;
+            released = true;
+        }
+    }
+    if (dir->num_slabs == 0 && dir->frames != NULL) {
+        free_block(payload_to_header(dir->frames));
+        dir->frames = NULL;
+        dir->frame_words = 0;
+        released = true;
+    }
+    return released;
+}
+
+#ifndef MM_THREAD_SAFE
+/**
+ * @brief Finds the fast bin for a block size.
+ *
+ * Mini blocks get no bin: their free list is an exact-size LIFO list
+ * already, and consolidating many of them at once would leave a long mini
+ * list, from which coalescing removes blocks by walking it.
+ *
+ * @param[in] size A block size
+ * @return The bin index, or FAST_BINS if blocks of this size aren't binned
+ */
+static size_t fast_index(size_t size) {
+    if (size < min_block_size) {
+        return FAST_BINS;
+    }
+    size_t index = (size - min_block_size) / dsize;
+    return (index < FAST_BINS) ? index : FAST_BINS;
+}
+
+/**
+ * @brief Coalesces every block in the fast bins into the free lists, and
+ *        returns the empty slabs kept for reuse to the heap.
+ * @return True if the fast bins held any block, or any slab was returned
+ */
+static bool consolidate_fast_bins(void) {
+    bool released = release_empty_slabs();
+    fast_bins_t *fast = arena->fast;
+    if (fast == NULL || fast->bytes == 0) {
+        return released;
+    }
+    for (size_t index = 0; index < FAST_BINS; index++) {
+        while (fast->bins[index] != NULL) {
+            block_t *block = fast->bins[index];
+            fast->bins[index] = block->next;
+            free_block(block);
+        }
+    }
+    fast->bytes = 0;
+    arena->stats.consolidations++;
+    return true;
+}
+
+/**
+ * @brief Takes a block of exactly `asize` bytes from the fast bins.
+ * @param[in] asize The adjusted size of the request
+ * @return A binned allocated block, or NULL if its bin is empty
+ */
+static block_t *fast_get(size_t asize) {
+    size_t index = fast_index(asize);
+    fast_bins_t *fast = arena->fast;
+    if (index == FAST_BINS || fast == NULL || fast->bins[index] == NULL) {
+        return NULL;
+    }
+    block_t *block = fast->bins[index];
+    fast->bins[index] = block->next;
+    fast->bytes -= asize;
+    return block;
+}
+
+/**
+ * @brief Puts a block being freed into its fast bin, if it has one.
+ *
+ * The block keeps its allocated header, so that it is neither coalesced
+ * nor split until the bins are consolidated, and its first payload word
+ * links it into the bin.
+ *
+ * @param[in] block An allocated block being freed
+ * @param[in] size The size of the block, from its header
+ * @return True if the block was binned, and false if the caller must free
+ *         it to the heap
+ */
+static bool fast_put(block_t *block, size_t size) {
+    size_t index = fast_index(size);
+    if (index == FAST_BINS) {
+        return false;
+    }
+    fast_bins_t *fast = arena->fast;
+    block->next = fast->bins[index];
+    fast->bins[index] = block;
+    fast->bytes += size;
+
+    if (fast->bytes > arena_heapsize() / fast_divisor) {
+        consolidate_fast_bins();
+    }
+    return true;
+}
+#endif
+
+/**
+ * @brief Allocates a block of `asize` bytes from the heap.
+ *
+ * Takes a fit from the free lists, extending the heap if there is none,
+ * marks it allocated and splits off any usable remainder.
+ *
+ * @param[in] asize The adjusted size of the request
+ * @return The allocated block, or NULL if the heap could not be extended
+ * @pre The current arena's lock is held, if any
+ */
+static block_t *alloc_block(size_t asize) {
+    // Search the free list for a fit
+    block_t *block = find_fit(asize);
+
+#ifndef MM_THREAD_SAFE
+    // Before growing the heap, see whether the fast bins hide a fit
+    if (block == NULL && consolidate_fast_bins()) {
+        block = find_fit(asize);
+    }
+#endif
+
+    // If no fit is found, request more memory, and then and place the block
+    if (block == NULL) {
+        block = extend_heap(heap_growth_size(asize));
+        // extend_heap returns an error
+        if (block == NULL) {
+            return NULL;
+        }
+    }
+
+    // The block should be marked as free
+    dbg_assert(!get_alloc(block));
+
+    // Take the block off its free list before its header changes
+    remove_free_block(block);
+
+    // Mark block as allocated
+    size_t block_size = get_size(block);
+    write_block(block, block_size, true, get_prev_alloc(block),
+                get_prev_mini(block));
+    write_prev_alloc(find_next(block), true);
+
+    // Try to split the block if too large
+    split_block(block, asize);
+    claim_fresh(block);
+    touch_block(block);
+    return block;
+}
+
+/**
+ * @brief Allocates a block of `asize` bytes from the heap whose payload is
+ *        aligned to `alignment`.
+ *
+ * A block big enough to hold `asize` bytes at any alignment is allocated
+ * as usual. The slack in front of its first suitably aligned payload
+ * address becomes a free block of its own, and split_block returns the
+ * slack behind the payload. Since payloads are always aligned to dsize,
+ * the leading slack is either empty or has room for at least a mini block.
+ *
+ * @param[in] asize The adjusted size of the request
+ * @param[in] alignment The alignment of the payload, a power of two
+ * @return The allocated block, or NULL if the heap could not be extended
+ * @pre `alignment > dsize`, and the current arena's lock is held, if any
+ */
+static block_t *alloc_aligned_block(size_t asize, size_t alignment) {
+    block_t *block = alloc_block(asize + alignment - dsize);
+    if (block == NULL) {
+        return NULL;
+    }
+
+    size_t misalign = (uintptr_t)header_to_payload(block) & (alignment - 1);
+    if (misalign != 0) {
+        size_t lead = alignment - misalign;
+        size_t size = get_size(block);
+        block_t *aligned = (block_t *)((char *)block + lead);
+        write_block(aligned, size - lead, true, false, lead == mini_block_size);
+        write_prev_mini(find_next(aligned), size - lead == mini_block_size);
+
+        // A block taken from the free lists never has a free predecessor,
+        // so the leading slack needs no coalescing
+        write_block(block, lead, false, get_prev_alloc(block),
+                    get_prev_mini(block));
+        insert_free_block(block);
+        block = aligned;
+    }
+
+    split_block(block, asize);
+    touch_block(block);
+    return block;
+}
+
+/**
+ * @brief Allocates up to `n` blocks of `asize` bytes each from the heap.
+ *
+ * The blocks are allocated in groups of up to max_chunksize bytes. Each
+ * group is taken from the free lists as a single block, which is then cut
+ * into consecutive blocks of `asize` bytes; the last of them keeps any
+ * excess that split_block left behind.
+ *
+ * @param[in] asize The adjusted size of each block
+ * @param[in] n The number of blocks to allocate
+ * @param[out] out Where to store the payload of each block
+ * @return The number of blocks allocated, which is less than `n` only if
+ *         the heap could not be extended
+ * @pre The current arena's lock is held, if any
+ */
+static size_t alloc_blocks(size_t asize, size_t n, void **out) {
+    size_t group_max = max(max_chunksize / asize, 1);
+    size_t count = 0;
+
+    while (count < n) {
+        size_t group = min(n - count, group_max);
+        block_t *block = alloc_block(group * asize);
+        if (block == NULL) {
+            break;
+        }
+
+        size_t size = get_size(block);
+        bool prev_alloc = get_prev_alloc(block);
+        bool prev_mini = get_prev_mini(block);
+        for (size_t i = 0; i < group; i++) {
+            size_t block_size = (i + 1 < group) ? asize : size;
+            write_block(block, block_size, true, prev_alloc, prev_mini);
+            out[count++] = header_to_payload(block);
+            size -= block_size;
+            prev_alloc = true;
+            prev_mini = (block_size == mini_block_size);
+            block = find_next(block);
+        }
+        write_prev_mini(block, prev_mini);
+    }
+    return count;
+}
+
+/**
+ * @brief Returns whether a block lives in a mapping of its own.
+ * @param[in] block An allocated block
+ * @return True if the block was allocated by alloc_huge
+ */
+static bool is_huge(block_t *block) {
+    return (load_header(block) & huge_mask) != 0;
+}
+
+/**
+ * @brief Allocates a block of `asize` bytes in a mapping of its own.
+ *
+ * The payload goes `alignment` bytes into the mapping, right after the
+ * header, and the block covers the mapping up to its last word. The
+ * header thus lies in the first page of the mapping, from which free_huge
+ * finds the start of the mapping again.
+ *
+ * @param[in] asize The adjusted size of the request
+ * @param[in] alignment The alignment of the payload, a power of two
+ * @return The allocated block, or NULL if no mapping could be made
+ * @pre `dsize <= alignment <= mem_pagesize()`
+ */
+static block_t *alloc_huge(size_t asize, size_t alignment) {
+    size_t length = round_up(asize + alignment, mem_pagesize());
+    char *start = mem_map(length);
+    if (start == NULL) {
+        return NULL;
+    }
+    block_t *block = (block_t *)(start + alignment - wsize);
+    block->header = pack(length - alignment, true, true, false) | huge_mask;
+    __atomic_fetch_add(&huge_blocks, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&huge_bytes, length, __ATOMIC_RELAXED);
+    return block;
+}
+
+/**
+ * @brief Unmaps a block allocated by alloc_huge.
+ * @param[in] block A huge block
+ */
+static void free_huge(block_t *block) {
+    dbg_requires(is_huge(block));
+    uintptr_t page_mask = (uintptr_t)mem_pagesize() - 1;
+    char *start = (char *)((uintptr_t)block & ~page_mask);
+    size_t length = (size_t)((char *)block - start) + wsize + get_size(block);
+    __atomic_fetch_sub(&huge_blocks, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&huge_bytes, length, __ATOMIC_RELAXED);
+    mem_unmap(start, length);
+}
+
+/**
+ * @brief Returns the slab a payload lives in, if any.
+ *
+ * Slab payloads have no header, so the frame bitmap is consulted before
+ * anything in front of `bp` is read. The thread-safe build makes no
+ * slabs, since a thread freeing a block of another arena could not read
+ * that arena's bitmap without its lock.
+ *
+ * @param[in] bp The payload of an allocated block or slot
+ * @return The slab holding `bp`, or NULL if `bp` is an ordinary block
+ */
+static slab_t *find_slab(void *bp) {
+#ifdef MM_THREAD_SAFE
+    return NULL;
+#else
+    slab_dir_t *dir = arena->slabs;
+    if (dir == NULL) {
+        return NULL;
+    }
+    // Payloads below the heap, such as huge ones, wrap to a large index
+    size_t index = slab_frame_index(bp);
+    if (index / 64 >= dir->frame_words ||
+        ((dir->frames[index / 64] >> (index % 64)) & 1) == 0) {
+        return NULL;
+    }
+    return (slab_t *)((uintptr_t)bp & ~(uintptr_t)(slab_size - 1));
+#endif
+}
+
+/**
+ * @brief Returns the free_slots bits of a slab whose slots are all free.
+ * @param[in] slot_count The number of slots in the slab, at most 64
+ * @return A mask of the low `slot_count` bits
+ */
+static word_t slab_all_free(size_t slot_count) {
+    return (slot_count == 64) ? ~(word_t)0 : ((word_t)1 << slot_count) - 1;
+}
+
+/**
+ * @brief Marks a slab frame in the frame bitmap, growing the bitmap if
+ *        need be.
+ * @param[in] index The frame index of the slab
+ * @param[in] is_slab Whether the frame now holds a slab
+ * @return True on success, false if the bitmap could not cover the frame
+ * @pre The current arena has a slab_dir_t
+ */
+static bool mark_slab_frame(size_t index, bool is_slab) {
+    slab_dir_t *dir = arena->slabs;
+    size_t words = index / 64 + 1;
+
+    if (words > dir->frame_words) {
+        if (words > slab_map_max_words) {
+            return false;
+        }
+        // Double the bitmap, moving it to a new block
+        size_t new_words =
+            min(max(words, 2 * dir->frame_words), slab_map_max_words);
+        block_t *block = alloc_block(adjust_size(new_words * wsize));
+        if (block == NULL) {
+            return false;
+        }
+        word_t *frames = (word_t *)header_to_payload(block);
+        memset(frames, 0, new_words * wsize);
+        if (dir->frames != NULL) {
+            memcpy(frames, dir->frames, dir->frame_words * wsize);
+            free_block(payload_to_header(dir->frames));
+        }
+        dir->frames = frames;
+        dir->frame_words = new_words;
+    }
+
+    word_t bit = (word_t)1 << (index % 64);
+    if (is_slab) {
+        dir->frames[index / 64] |= bit;
+    } else {
+        dir->frames[index / 64] &= ~bit;
+    }
+    return true;
+}
+
+/**
+ * @brief Cuts a slab into free slots of a class and makes it the head of
+ *        the class's partial list.
+ * @param[in] slab A slab on no list, whose slots are all free
+ * @param[in] class The slab class, whose slots hold (class + 1) * dsize bytes
+ */
+static void format_slab(slab_t *slab, size_t class) {
+    size_t slot_size = (class + 1) * dsize;
+    size_t slot_count = min((slab_size - sizeof(slab_t)) / slot_size, 64);
+    slab->slot_size = (uint32_t)slot_size;
+    slab->slot_count = (uint32_t)slot_count;
+    slab->free_slots = slab_all_free(slot_count);
+
+    slab_dir_t *dir = arena->slabs;
+    slab->prev = NULL;
+    slab->next = dir->partial[class];
+    if (slab->next != NULL) {
+        slab->next->prev = slab;
+    }
+    dir->partial[class] = slab;
+}
+
+/**
+ * @brief Makes a new, empty slab for a size class and puts it on the
+ *        class's list of slabs with free slots.
+ * @param[in] class A slab size class
+ * @return The new slab, or NULL if no memory could be obtained or the
+ *         frame bitmap cannot cover it
+ * @pre The current arena has a slab_dir_t
+ */
+static slab_t *create_slab(size_t class) {
+    block_t *block = alloc_aligned_block(adjust_size(slab_size), slab_size);
+    if (block == NULL) {
+        return NULL;
+    }
+    slab_t *slab = (slab_t *)header_to_payload(block);
+    if (!mark_slab_frame(slab_frame_index(slab), true)) {
+        free_block(block);
+        return NULL;
+    }
+
+    arena->slabs->num_slabs++;
+    format_slab(slab, class);
+    return slab;
+}
+
+/**
+ * @brief Allocates a request from a slab, if slabs serve its size.
+ *
+ * Slabs serve the sizes that they hold more tightly than blocks: those
+ * where rounding up to a whole slot saves the dsize that a block needs for
+ * its header and alignment. Others go to the heap, as do all requests
+ * while the heap is still small.
+ *
+ * @param[in] size The payload size in bytes
+ * @return A free slot of the slab size class for `size`, or NULL if the
+ *         request should go to the heap instead
+ */
+static void *slab_malloc(size_t size) {
+#ifdef MM_THREAD_SAFE
+    return NULL;
+#else
+    size_t slot_size = round_up(size, dsize);
+    if (slot_size > slab_max_slot || slot_size + dsize != adjust_size(size) ||
+        arena_heapsize() < slab_min_heap) {
+        return NULL;
+    }
+
+    dbg_requires(mm_checkheap(__LINE__));
+    if (arena->slabs == NULL) {
+        // The directory waits, zeroed, right after the fast bins
+        arena->slabs = (slab_dir_t *)(arena->fast + 1);
+    }
+
+    size_t class = slot_size / dsize - 1;
+    slab_dir_t *dir = arena->slabs;
+    slab_t *slab = dir->partial[class];
+    // Rather than carve a new slab, recut a kept empty one, preferably of
+    // this class
+    for (size_t i = 0; slab == NULL && i < NUM_SLAB_CLASSES; i++) {
+        size_t from = (class + i) % NUM_SLAB_CLASSES;
+        if ((slab = dir->empty[from]) != NULL) {
+            dir->empty[from] = NULL;
+            format_slab(slab, class);
+        }
+    }
+    if (slab == NULL && (slab = create_slab(class)) == NULL) {
+        return NULL;
+    }
+
+    // Take the lowest free slot, retiring the slab from the list once full
+    size_t index = (size_t)__builtin_ctzl(slab->free_slots);
+    slab->free_slots &= slab->free_slots - 1;
+    if (slab->free_slots == 0) {
+        arena->slabs->partial[class] = slab->next;
+        if (slab->next != NULL) {
+            slab->next->prev = NULL;
+        }
+    }
+    dbg_ensures(mm_checkheap(__LINE__));
+    audit_heap(__LINE__);
+    return (char *)slab + sizeof(slab_t) + index * slot_size;
+#endif
+}
+
+/**
+ * @brief Frees a slot of a slab.
+ *
+ * A full slab goes back on its class's list. A slab that becomes empty is
+ * kept, to be recut for whichever class next runs out of free slots,
+ * unless its class already has an empty slab, in which case it is returned
+ * to the heap at once. The kept
+ * slabs are returned when the fast bins are consolidated, so that they do
+ * not keep the free space around them from coalescing for long. The
+ * slab_dir_t stays, so that a malloc/free pair of one slot never makes or
+ * frees a block.
+ *
+ * @param[in] slab The slab holding `bp`
+ * @param[in] bp The payload of an allocated slot
+ */
+static void slab_free(slab_t *slab, void *bp) {
+    dbg_requires(mm_checkheap(__LINE__));
+    char *slots = (char *)slab + sizeof(slab_t);
+    size_t index = (size_t)((char *)bp - slots) / slab->slot_size;
+    dbg_assert(((slab->free_slots >> index) & 1) == 0);
+
+    slab_dir_t *dir = arena->slabs;
+    size_t class = slab->slot_size / dsize - 1;
+    slab_t **head = &dir->partial[class];
+    if (slab->free_slots == 0) {
+        slab->prev = NULL;
+        slab->next = *head;
+        if (slab->next != NULL) {
+            slab->next->prev = slab;
+        }
+        *head = slab;
+    }
+    slab->free_slots |= (word_t)1 << index;
+
+    if (slab->free_slots == slab_all_free(slab->slot_count)) {
+        if (slab->prev != NULL) {
+            slab->prev->next = slab->next;
+        } else {
+            *head = slab->next;
+        }
+        if (slab->next != NULL) {
+            slab->next->prev = slab->prev;
+        }
+        if (dir->empty[class] == NULL) {
+            dir->empty[class] = slab;
+        } else {
+            release_slab(slab);
+        }
+    }
+    dbg_ensures(mm_checkheap(__LINE__));
+    audit_heap(__LINE__);
+}
+
+/**
+ * @brief Acquires the current arena's lock (a no-op unless built with
+ *        MM_THREAD_SAFE).
+ */
+static void lock_arena(void) {
+#ifdef MM_THREAD_SAFE
+    pthread_mutex_lock(&arena->lock);
+#endif
+}
+
+/**
+ * @brief Releases the current arena's lock (a no-op unless built with
+ *        MM_THREAD_SAFE).
+ */
+static void unlock_arena(void) {
+#ifdef MM_THREAD_SAFE
+    pthread_mutex_unlock(&arena->lock);
+#endif
+}
+
+/**
+ * @brief Creates an empty heap in the current arena.
+ *
+ * Writes the prologue and epilogue, empties the free lists and extends
+ * the heap with a free block of chunksize bytes.
+ *
+ * @return True on success, false if the heap could not be extended
+ */
+static bool init_arena(void) {
+    arena->fresh = arena_heap_fresh();
+
+    // Create the initial empty heap
+    word_t *start = (word_t *)(arena_sbrk((intptr_t)(2 * wsize)));
+
+    if (start == (void *)-1) {
+        return false;
+    }
+
+    /*
+     * The prologue is an allocated footer before the first block, and the
+     * epilogue an allocated header of size 0 after the last one. Neither
+     * is ever merged, so coalesce_block needs no bounds checks, and
+     * extend_heap turns the epilogue into the header of the new block.
+     */
+
+    start[0] = pack(0, true, true, false); // Heap prologue (block footer)
+    start[1] = pack(0, true, true, false); // Heap epilogue (block header)
+
+    // Heap starts with first "block header", currently the epilogue
+    arena->heap_start = (block_t *)&(start[1]);
+
+    // Every trace starts from a fresh heap, so drop any stale list heads
+    for (size_t index = 0; index < NUM_SEG_LISTS; index++) {
+        arena->seg_lists[index] = NULL;
+    }
+    arena->mini_list = NULL;
+    arena->large_tree = NULL;
+    arena->seg_bitmap = 0;
+    arena->frees = 0;
+    arena->slabs = NULL;
+#ifndef MM_THREAD_SAFE
+    arena->fast = NULL;
+#endif
+    for (size_t i = 0; i < CHECK_TOUCHED; i++) {
+        arena->touched[i] = NULL;
+    }
+    arena->num_touched = 0;
+    arena->check_cursor = NULL;
+    arena->ops = 0;
+    memset(&arena->stats, 0, sizeof(arena->stats));
+
+    // Extend the empty heap with a free block of chunksize bytes
+    if (extend_heap(chunksize) == NULL) {
+        return false;
+    }
+
+#ifndef MM_THREAD_SAFE
+    // The fast bins and the slab directory take the first block, where they
+    // split no free space and stay for as long as the heap does
+    size_t size = sizeof(fast_bins_t) + sizeof(slab_dir_t);
+    block_t *block = alloc_block(adjust_size(size));
+    if (block == NULL) {
+        return false;
+    }
+    arena->fast = (fast_bins_t *)header_to_payload(block);
+    memset(arena->fast, 0, size);
+#endif
+
+    return true;
+}
+
+#ifdef MM_THREAD_SAFE
+/**
+ * @brief Frees a block of another arena without taking its lock.
+ *
+ * The block stays marked allocated, and is pushed onto the owner's remote
+ * free stack with a single compare-and-swap.
+ *
+ * @param[in] owner The arena the block belongs to
+ * @param[in] block An allocated block being freed
+ */
+static void remote_free(arena_t *owner, block_t *block) {
+    block_t *head = __atomic_load_n(&owner->remote_frees, __ATOMIC_RELAXED);
+    do {
+        block->next = head;
+    } while (!__atomic_compare_exchange_n(&owner->remote_frees, &head, block,
+                                          true, __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED));
+}
+
+/**
+ * @brief Frees every block on the current arena's remote free stack.
+ *
+ * The whole stack is taken with one exchange, so pushes may continue
+ * while it is drained.
+ *
+ * @pre The current arena's lock is held
+ */
+static void drain_remote_frees(void) {
+    if (__atomic_load_n(&arena->remote_frees, __ATOMIC_RELAXED) == NULL) {
+        return;
+    }
+    block_t *block =
+        __atomic_exchange_n(&arena->remote_frees, NULL, __ATOMIC_ACQUIRE);
+    while (block != NULL) {
+        block_t *next = block->next;
+        free_block(block);
+        block = next;
+    }
+}
+#endif
+
+/**
+ * @brief Locks the current arena for an allocation, initializing its heap
+ *        if need be.
+ *
+ * In a thread-safe build, the blocks other threads have freed to the
+ * arena are freed for real first.
+ *
+ * @return True with the lock held, or false if the heap could not be
+ *         initialized
+ */
+static bool enter_arena(void) {
+    lock_arena();
+    dbg_requires(mm_checkheap(__LINE__));
+
+    // Initialize heap if it isn't initialized
+    if (arena->heap_start == NULL) {
+        if (!(init_arena())) {
+            dbg_printf("Problem initializing heap. Likely due to sbrk");
+            unlock_arena();
+            return false;
+        }
+    }
+
+#ifdef MM_THREAD_SAFE
+    drain_remote_frees();
+    flush_requests();
+#endif
+    return true;
+}
+
+/**
+ * @brief Clears the start of a payload that was just allocated, skipping
+ *        the bytes that already read as zero.
+ *
+ * The bytes at or above `fresh` have not been written since the memory
+ * system handed them out, except for the links and footer the block may
+ * have had while it was free, which are cleared along with everything
+ * below `fresh`.
+ *
+ * @param[in] block A block allocated since the fresh mark was `fresh`
+ * @param[in] size The number of payload bytes to clear
+ * @param[in] fresh The current arena's fresh mark before the allocation
+ */
+static void clear_payload(block_t *block, size_t size, char *fresh) {
+    char *payload = header_to_payload(block);
+    char *end = payload + size;
+
+    // Everything below the fresh mark, and the links of a free block
+    char *dirty = payload + sizeof(block_t) - wsize;
+    dirty = (fresh > dirty) ? fresh : dirty;
+    dirty = (dirty < end) ? dirty : end;
+    memset(payload, 0, (size_t)(dirty - payload));
+
+    // The footer of a free block, in the last word of the block
+    char *footer = (char *)find_next(block) - wsize;
+    if (footer < end && footer >= dirty) {
+        memset(footer, 0, (size_t)(end - footer));
+    }
+}
+
+/**
+ * @brief Allocates a block of `asize` bytes from the current arena, under
+ *        its lock.
+ * @param[in] asize The adjusted size of the request
+ * @param[in] alignment The alignment of the payload, a power of two no
+ *                      smaller than dsize
+ * @param[in] zero The number of payload bytes to clear, which may be 0
+ * @return The allocated block, or NULL if the arena is out of memory
+ */
+static block_t *arena_malloc(size_t asize, size_t alignment, size_t zero) {
+    if (!enter_arena()) {
+        return NULL;
+    }
+
+    char *fresh = arena->fresh;
+    block_t *block = (alignment > dsize) ? alloc_aligned_block(asize, alignment)
+                                         : alloc_block(asize);
+    if (block != NULL && zero > 0) {
+        clear_payload(block, zero, fresh);
+    }
+
+    dbg_ensures(mm_checkheap(__LINE__));
+    audit_heap(__LINE__);
+    unlock_arena();
+    return block;
+}
+
+/**
+ * @brief Allocates up to `n` blocks of `asize` bytes each from the current
+ *        arena, under its lock.
+ * @param[in] asize The adjusted size of each block
+ * @param[in] n The number of blocks to allocate
+ * @param[out] out Where to store the payload of each block
+ * @return The number of blocks allocated
+ */
+static size_t arena_malloc_batch(size_t asize, size_t n, void **out) {
+    if (!enter_arena()) {
+        return 0;
+    }
+
+    size_t count = alloc_blocks(asize, n, out);
+
+    dbg_ensures(mm_checkheap(__LINE__));
+    audit_heap(__LINE__);
+    unlock_arena();
+    return count;
+}
+
+#ifdef MM_THREAD_SAFE
+/**
+ * @brief Finds the arena a block belongs to.
+ * @param[in] block A block in some arena
+ * @return The arena whose heap contains `block`
+ */
+static arena_t *find_arena(block_t *block) {
+    if (mem_in_heap(block)) {
+        return &main_arena;
+    }
+    return mem_region_lo(mem_region_of(block, arena_region_size));
+}
+
+/**
+ * @brief Creates an arena at the start of a new region.
+ * @return The new arena, or NULL if no region could be obtained
+ */
+static arena_t *create_arena(void) {
+    mem_region_t *region = mem_region_create(arena_region_size);
+    if (region == NULL) {
+        return NULL;
+    }
+    arena_t *new_arena = mem_region_sbrk(region, (intptr_t)round_up(
+                                                     sizeof(arena_t), dsize));
+    if (new_arena == (void *)-1) {
+        mem_region_destroy(region);
+        return NULL;
+    }
+    pthread_mutex_init(&new_arena->lock, NULL);
+    new_arena->region = region;
+
+    arena_t *saved = arena;
+    arena = new_arena;
+    bool ok = init_arena();
+    arena = saved;
+    if (!ok) {
+        mem_region_destroy(region);
+        return NULL;
+    }
+    return new_arena;
+}
+
+/**
+ * @brief Returns the calling thread's arena, assigning one round-robin
+ *        on the thread's first allocation.
+ *
+ * Arenas are created on first use. If a region cannot be obtained, the
+ * thread shares the main arena.
+ *
+ * @return The arena the calling thread allocates from
+ */
+static arena_t *home_arena(void) {
+    if (thread_arena != NULL) {
+        return thread_arena;
+    }
+    size_t index =
+        __atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED) % arena_count;
+    pthread_mutex_lock(&arenas_lock);
+    if (arenas[index] == NULL) {
+        arenas[index] = (index == 0) ? &main_arena : create_arena();
+    }
+    thread_arena = (arenas[index] != NULL) ? arenas[index] : &main_arena;
+    pthread_mutex_unlock(&arenas_lock);
+    return thread_arena;
+}
+#endif
+
+/**
+ * @brief Allocates a block from the heap of the calling thread's arena.
+ *
+ * In a thread-safe build, an arena whose region is full falls back to the
+ * main heap.
+ *
+ * @param[in] asize The adjusted size of the request
+ * @param[in] alignment The alignment of the payload, a power of two no
+ *                      smaller than dsize
+ * @param[in] zero The number of payload bytes to clear, which may be 0
+ * @return The allocated block, or NULL if no memory could be obtained
+ */
+static block_t *heap_malloc(size_t asize, size_t alignment, size_t zero) {
+#ifdef MM_THREAD_SAFE
+    arena = home_arena();
+#endif
+    block_t *block = arena_malloc(asize, alignment, zero);
+
+#ifdef MM_THREAD_SAFE
+    if (block == NULL && arena != &main_arena) {
+        arena = &main_arena;
+        block = arena_malloc(asize, alignment, zero);
+    }
+#endif
+    return block;
+}
+
+#ifdef MM_THREAD_SAFE
+/**
+ * @brief Frees a run of consecutive blocks to the arena that owns them.
+ *
+ * A run in the calling thread's own arena is freed as one block under its
+ * lock, and the blocks of a run in any other arena are handed to it one
+ * by one through remote_free.
+ *
+ * @param[in] block The first block of the run
+ * @param[in] size The total size of the blocks in the run
+ */
+static void release_run(block_t *block, size_t size) {
+    arena_t *owner = find_arena(block);
+    if (owner != thread_arena) {
+        char *end = (char *)block + size;
+        while ((char *)block < end) {
+            // The owner may free the block as soon as it is pushed
+            block_t *next =
+                (block_t *)((char *)block + extract_size(load_header(block)));
+            remote_free(owner, block);
+            block = next;
+        }
+        return;
+    }
+    arena = owner;
+    lock_arena();
+    dbg_requires(mm_checkheap(__LINE__));
+    free_run(block, size);
+    flush_requests();
+    dbg_ensures(mm_checkheap(__LINE__));
+    audit_heap(__LINE__);
+    unlock_arena();
+}
+
+/**
+ * @brief Frees a block to the arena that owns it.
+ *
+ * Blocks of the calling thread's own arena are freed under its lock, and
+ * blocks of any other arena are handed to it through remote_free.
+ *
+ * @param[in] block An allocated block
+ */
+static void release_block(block_t *block) {
+    // Other threads may update the header flags concurrently
+    release_run(block, extract_size(load_header(block)));
+}
+
+/**
+ * @brief Finds the per-thread cache bin for a block size.
+ * @param[in] asize A block size
+ * @return The bin index, or TCACHE_BINS if blocks of this size aren't cached
+ */
+static size_t tcache_index(size_t asize) {
+    size_t index = asize / dsize - 1;
+    return (index < TCACHE_BINS) ? index : TCACHE_BINS;
+}
+
+/**
+ * @brief Returns every block in a thread's cache to the heap.
+ *
+ * Runs as the tcache_key destructor when a thread exits, so that blocks a
+ * thread cached are not lost with it.
+ *
+ * @param[in] arg The thread's tcache_t
+ */
+static void tcache_flush(void *arg) {
+    tcache_t *cache = arg;
+    for (size_t index = 0; index < TCACHE_BINS; index++) {
+        while (cache->bins[index] != NULL) {
+            block_t *block = cache->bins[index];
+            cache->bins[index] = block->next;
+            release_block(block);
+        }
+        cache->counts[index] = 0;
+    }
+}
+
+/** @brief Creates tcache_key; called once through tcache_key_once. */
+static void tcache_create_key(void) {
+    pthread_key_create(&tcache_key, tcache_flush);
+}
+
+/**
+ * @brief Takes a block of exactly `asize` bytes from the thread's cache.
+ * @param[in] asize The adjusted size of the request
+ * @return A cached allocated block, or NULL if the bin is empty
+ */
+static block_t *tcache_get(size_t asize) {
+    size_t index = tcache_index(asize);
+    if (index == TCACHE_BINS || tcache.bins[index] == NULL) {
+        return NULL;
+    }
+    block_t *block = tcache.bins[index];
+    tcache.bins[index] = block->next;
+    tcache.counts[index]--;
+    return block;
+}
+
+/**
+ * @brief Caches a block being freed, if its bin has room.
+ *
+ * The block keeps its allocated header, and its first payload word links
+ * it into the bin.
+ *
+ * @param[in] block An allocated block being freed
+ * @param[in] size The size of the block, from its header
+ * @return True if the block was cached, and false if the caller must free
+ *         it to the heap
+ */
+static bool tcache_put(block_t *block, size_t size) {
+    size_t index = tcache_index(size);
+    if (index == TCACHE_BINS || tcache.counts[index] >= tcache_fill) {
+        return false;
+    }
+    if (!tcache.registered) {
+        // Arm the destructor that flushes this cache when the thread exits
+        pthread_once(&tcache_key_once, tcache_create_key);
+        pthread_setspecific(tcache_key, &tcache);
+        tcache.registered = true;
+    }
+    block->next = tcache.bins[index];
+    tcache.bins[index] = block;
+    tcache.counts[index]++;
+    return true;
+}
+#endif
+
+/**
+ * @brief Frees a block that lives in the heap of some arena.
+ *
+ * Small blocks go to the calling thread's cache first in a thread-safe
+ * build, and to the fast bins otherwise.
+ *
+ * @param[in] block An allocated block that is not huge
+ * @param[in] size The size of the block, which the caller has already read
+ *                 from its header
+ */
+static void heap_free(block_t *block, size_t size) {
+#ifdef MM_THREAD_SAFE
+    // Keep small blocks in this thread's cache, without taking a lock
+    if (!tcache_put(block, size)) {
+        release_block(block);
+    }
+#else
+    dbg_requires(mm_checkheap(__LINE__));
+    if (!fast_put(block, size)) {
+        free_block(block);
+    }
+    dbg_ensures(mm_checkheap(__LINE__));
+    audit_heap(__LINE__);
+#endif
+}
+
+/**
+ * @brief Orders two payload pointers by address, for qsort.
+ * @param[in] a A pointer to the first payload pointer
+ * @param[in] b A pointer to the second payload pointer
+ * @return A negative, zero or positive value as the first payload lies
+ *         below, at or above the second
+ */
+static int compare_payloads(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)(*(void *const *)a);
+    uintptr_t y = (uintptr_t)(*(void *const *)b);
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Resizes a heap block without moving its payload.
+ *
+ * Shrinking splits the tail of the block off into a free block, and
+ * growing tries to absorb a free successor.
+ *
+ * @param[in] block An allocated block in some arena
+ * @param[in] asize The adjusted size the block needs
+ * @return True if the block now has size about `asize`, and false if the
+ *         payload has to move
+ */
+static bool resize_block(block_t *block, size_t asize) {
+#ifdef MM_THREAD_SAFE
+    arena = find_arena(block);
+#endif
+    lock_arena();
+    dbg_requires(mm_checkheap(__LINE__));
+
+    bool resized = true;
+    if (asize <= get_size(block)) {
+        split_block(block, asize);
+    } else {
+        resized = grow_block(block, asize);
+    }
+
+    dbg_ensures(mm_checkheap(__LINE__));
+    audit_heap(__LINE__);
+    unlock_arena();
+    return resized;
+}
+
+/**
+ * @brief Reports a heap inconsistency found by mm_checkheap.
+ * @param[in] line The line mm_checkheap was called from
+ * @param[in] addr The block or structure at fault
+ * @param[in] what What is wrong with it
+ * @return False, for the check to return
+ */
+static bool check_fail(int line, const void *addr, const char *what) {
+    fprintf(stderr, "mm_checkheap (line %d): %s at %p\n", line, what, addr);
+    return false;
+}
+
+/**
+ * @brief Returns the epilogue header of the current arena's heap.
+ * @return The epilogue, which ends the heap
+ */
+static block_t *find_epilogue(void) {
+    return (block_t *)((char *)arena_heap_hi() - 7);
+}
+
+/**
+ * @brief Returns whether an address may be the header of a block of the
+ *        current arena, so that it is safe to read.
+ * @param[in] block Any address
+ * @return True if `block` lies in the heap, below the epilogue, and has a
+ *         payload aligned to dsize
+ */
+static bool is_heap_block(const block_t *block) {
+    return block >= arena->heap_start && block < find_epilogue() &&
+           ((uintptr_t)block + wsize) % dsize == 0;
+}
+
+/**
+ * @brief Checks the tree links of a free block in the large block tree
+ *        against its parent and children.
+ * @param[in] line The line mm_checkheap was called from
+ * @param[in] node A free block of the tree size class
+ * @return True if the links are consistent
+ */
+static bool check_tree_links(int line, block_t *node) {
+    block_t *parent = node->parent;
+    if (parent == NULL ? arena->large_tree != node
+                       : !is_heap_block(parent) ||
+                             (parent->left != node && parent->right != node)) {
+        return check_fail(line, node, "tree node not a child of its parent");
+    }
+
+    block_t *children[2] = {node->left, node->right};
+    for (size_t i = 0; i < 2; i++) {
+        block_t *child = children[i];
+        if (child == NULL) {
+            continue;
+        }
+        if (!is_heap_block(child) || get_alloc(child) ||
+            child->parent != node) {
+            return check_fail(line, node, "tree child does not link back");
+        }
+        if (node->red && child->red) {
+            return check_fail(line, node, "red tree node has a red child");
+        }
+        if ((i == 0) ? !tree_less(child, node) : !tree_less(node, child)) {
+            return check_fail(line, node, "tree children out of order");
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Checks the free list links of a free block against its
+ *        neighbors on the list.
+ *
+ * The block must be the head of its class list if it has no predecessor,
+ * and each neighbor must be a free block of the same class that links
+ * back to it. The mini list is singly linked, so only its successor is
+ * checked.
+ *
+ * @param[in] line The line mm_checkheap was called from
+ * @param[in] block A free block
+ * @return True if the links are consistent
+ */
+static bool check_links(int line, block_t *block) {
+    size_t size = get_size(block);
+    block_t *next = block->next;
+
+    if (size == mini_block_size) {
+        if (next != NULL && (!is_heap_block(next) || get_alloc(next) ||
+                             get_size(next) != mini_block_size)) {
+            return check_fail(line, block, "mini list leads off the list");
+        }
+        return true;
+    }
+
+    size_t index = find_seg_index(size);
+    if (index == tree_index) {
+        return check_tree_links(line, block);
+    }
+
+    block_t *prev = block->prev;
+    if (prev == NULL ? arena->seg_lists[index] != block
+                     : !is_heap_block(prev) || prev->next != block) {
+        return check_fail(line, block, "free list predecessor lost block");
+    }
+    if (next != NULL &&
+        (!is_heap_block(next) || next->prev != block || get_alloc(next) ||
+         get_size(next) == mini_block_size ||
+         find_seg_index(get_size(next)) != index)) {
+        return check_fail(line, block, "free list successor inconsistent");
+    }
+    return true;
+}
+
+/**
+ * @brief Checks one block of the current arena's heap against its
+ *        neighbors.
+ *
+ * The block must lie within the heap, with a valid size and no huge flag,
+ * and the next block's previous-allocated and previous-mini bits must
+ * describe it. A free block must further carry a footer equal to its
+ * header, have no free neighbor, and be linked into its free list.
+ *
+ * @param[in] line The line mm_checkheap was called from
+ * @param[in] block The header of a block, which need not be valid
+ * @return True if the block is consistent
+ */
+static bool check_block(int line, block_t *block) {
+    if (!is_heap_block(block)) {
+        return check_fail(line, block, "block outside the heap");
+    }
+    word_t header = block->header;
+    size_t size = extract_size(header);
+    if (size < mini_block_size || size % dsize != 0 ||
+        (header & huge_mask) != 0) {
+        return check_fail(line, block, "bad block size or flags");
+    }
+    if ((char *)block + size > (char *)find_epilogue()) {
+        return check_fail(line, block, "block runs past the epilogue");
+    }
+
+    block_t *next = find_next(block);
+    if (get_prev_alloc(next) != extract_alloc(header) ||
+        get_prev_mini(next) != (size == mini_block_size)) {
+        return check_fail(line, next, "flags disagree with previous block");
+    }
+    if (extract_alloc(header)) {
+        return true;
+    }
+
+    if (has_footer(size) && *header_to_footer(block) != header) {
+        return check_fail(line, block, "footer does not match header");
+    }
+    if (!get_prev_alloc(block) || !get_alloc(next)) {
+        return check_fail(line, block, "free block not coalesced");
+    }
+    return check_links(line, block);
+}
+
+/**
+ * @brief Checks the parts of the current arena that every heap check
+ *        covers, in constant time.
+ *
+ * These are the prologue and epilogue, the free list heads against the
+ * bitmap of non-empty classes, the tree root, and the fast bin heads.
+ *
+ * @param[in] line The line mm_checkheap was called from
+ * @return True if they are consistent
+ */
+static bool check_arena_heads(int line) {
+    word_t prologue = *((word_t *)arena->heap_start - 1);
+    if (extract_size(prologue) != 0 || !extract_alloc(prologue)) {
+        return check_fail(line, arena->heap_start, "bad prologue");
+    }
+    block_t *epilogue = find_epilogue();
+    if (get_size(epilogue) != 0 || !get_alloc(epilogue)) {
+        return check_fail(line, epilogue, "bad epilogue");
+    }
+
+    for (size_t index = 0; index < NUM_SEG_LISTS; index++) {
+        block_t *head = arena->seg_lists[index];
+        bool bit = (arena->seg_bitmap >> index) & 1;
+        if (bit != (head != NULL)) {
+            return check_fail(line, head, "bitmap disagrees with list");
+        }
+        if (head != NULL && (!is_heap_block(head) || head->prev != NULL)) {
+            return check_fail(line, head, "bad free list head");
+        }
+    }
+    block_t *root = arena->large_tree;
+    bool tree_bit = (arena->seg_bitmap >> tree_index) & 1;
+    if (tree_bit != (root != NULL) || (arena->seg_bitmap >> tree_index) > 1) {
+        return check_fail(line, root, "bitmap disagrees with tree");
+    }
+    if (root != NULL &&
+        (!is_heap_block(root) || root->parent != NULL || root->red)) {
+        return check_fail(line, root, "bad tree root");
+    }
+    if (arena->mini_list != NULL && !is_heap_block(arena->mini_list)) {
+        return check_fail(line, arena->mini_list, "bad mini list head");
+    }
+
+#ifndef MM_THREAD_SAFE
+    fast_bins_t *fast = arena->fast;
+    for (size_t index = 0; fast != NULL && index < FAST_BINS; index++) {
+        block_t *head = fast->bins[index];
+        if (head != NULL && (!is_heap_block(head) || !get_alloc(head) ||
+                             fast_index(get_size(head)) != index)) {
+            return check_fail(line, head, "bad fast bin head");
+        }
+    }
+#endif
+    return true;
+}
+
+/**
+ * @brief Checks a subtree of the large block tree against the red-black
+ *        and search tree properties.
+ * @param[in] line The line mm_checkheap was called from
+ * @param[in] node The subtree root, or NULL
+ * @param[in] lo The node every node of the subtree follows, or NULL
+ * @param[in] hi The node every node of the subtree precedes, or NULL
+ * @param[in,out] count The number of nodes seen so far
+ * @param[in] limit The number of nodes the tree should have
+ * @param[out] height The number of black nodes on every path down
+ * @return True if the subtree is consistent
+ */
+static bool check_tree(int line, block_t *node, block_t *lo, block_t *hi,
+                       size_t *count, size_t limit, size_t *height) {
+    if (node == NULL) {
+        *height = 0;
+        return true;
+    }
+    if (++*count > limit) {
+        return check_fail(line, node, "tree holds blocks not free in heap");
+    }
+    if (!is_heap_block(node) || get_alloc(node) ||
+        find_seg_index(get_size(node)) != tree_index) {
+        return check_fail(line, node, "tree holds a bad block");
+    }
+    if ((lo != NULL && !tree_less(lo, node)) ||
+        (hi != NULL && !tree_less(node, hi))) {
+        return check_fail(line, node, "tree out of order");
+    }
+
+    size_t left_height;
+    size_t right_height;
+    if (!check_tree(line, node->left, lo, node, count, limit, &left_height) ||
+        !check_tree(line, node->right, node, hi, count, limit,
+                    &right_height)) {
+        return false;
+    }
+    if (left_height != right_height) {
+        return check_fail(line, node, "tree black heights differ");
+    }
+    *height = left_height + (node->red ? 0 : 1);
+    return true;
+}
+
+/**
+ * @brief Walks one free list, checking that it holds exactly the free
+ *        blocks of its class.
+ * @param[in] line The line mm_checkheap was called from
+ * @param[in] head The first block of the list
+ * @param[in] index The size class of the list, or NUM_SEG_LISTS + 1 for
+ *                  the mini list
+ * @param[in] count The number of free blocks of the class in the heap
+ * @return True if the list is consistent
+ */
+static bool check_list(int line, block_t *head, size_t index, size_t count) {
+    size_t seen = 0;
+    for (block_t *block = head; block != NULL; block = block->next) {
+        if (++seen > count) {
+            return check_fail(line, head, "list holds blocks not free in heap");
+        }
+        size_t size = is_heap_block(block) ? get_size(block) : 0;
+        bool mini = (size == mini_block_size);
+        if (size == 0 || get_alloc(block) ||
+            (mini ? index != NUM_SEG_LISTS + 1
+                  : find_seg_index(size) != index)) {
+            return check_fail(line, block, "list holds a bad block");
+        }
+    }
+    if (seen != count) {
+        return check_fail(line, head, "free blocks missing from list");
+    }
+    return true;
+}
+
+#ifndef MM_THREAD_SAFE
+/**
+ * @brief Checks that the fast bins hold allocated blocks of their sizes
+ *        that add up to the recorded total.
+ * @param[in] line The line mm_checkheap was called from
+ * @param[in] limit The number of allocated blocks in the heap
+ * @return True if the fast bins are consistent
+ */
+static bool check_fast_bins(int line, size_t limit) {
+    fast_bins_t *fast = arena->fast;
+    if (fast == NULL) {
+        return true;
+    }
+    size_t bytes = 0;
+    size_t seen = 0;
+    for (size_t index = 0; index < FAST_BINS; index++) {
+        for (block_t *block = fast->bins[index]; block != NULL;
+             block = block->next) {
+            if (++seen > limit) {
+                return check_fail(line, fast, "fast bins hold a cycle");
+            }
+            if (!is_heap_block(block) || !get_alloc(block) ||
+                fast_index(get_size(block)) != index ||
+                find_slab(header_to_payload(block)) != NULL) {
+                return check_fail(line, block, "fast bin holds a bad block");
+            }
+            bytes += get_size(block);
+        }
+    }
+    if (bytes != fast->bytes) {
+        return check_fail(line, fast, "fast bin total is wrong");
+    }
+    return true;
+}
+#endif
+
+/**
+ * @brief Checks the slab bookkeeping against the slabs found in the heap.
  *
- * <What does this function do?>
- * <What are the function's arguments?>
- * <What is the function's return value?>
- * <Are there any preconditions or postconditions?>
+ * Every frame marked in the bitmap must hold a slab, and every slab with
+ * a free slot must be on the list of its class.
  *
- * @param[in] size
- * @return
+ * @param[in] line The line mm_checkheap was called from
+ * @param[in] num_slabs The number of slab blocks found in the heap
+ * @return True if the slabs are consistent
  */
-static block_t *extend_heap(size_t size) {
-    void *bp;
-
-    // Allocate an even number of words to maintain alignment
-    size = round_up(size, dsize);
-    if ((bp = mem_sbrk((intptr_t)size)) == (void *)-1) {
-        return NULL;
+static bool check_slabs(int line, size_t num_slabs) {
+    slab_dir_t *dir = arena->slabs;
+    if (dir == NULL) {
+        return (num_slabs == 0) || check_fail(line, dir, "slabs lack a dir");
     }
 
-    /*
-     * TODO: delete or replace this comment once you've thought about it.
-     * Think about what bp represents. Why do we write the new block
-     * starting one word BEFORE bp, but with the same size that we
-     * originally requested?
-     */
-
-    // Initialize free block header/footer
-    block_t *block = payload_to_header(bp);
-    write_block(block, size, false);
-
-    // Create new epilogue header
-    block_t *block_next = find_next(block);
-    write_epilogue(block_next);
-
-    // Coalesce in case the previous block was free
-    block = coalesce_block(block);
+    size_t marked = 0;
+    for (size_t i = 0; i < dir->frame_words; i++) {
+        marked += (size_t)__builtin_popcountl(dir->frames[i]);
+    }
+    if (marked != num_slabs || dir->num_slabs != num_slabs) {
+        return check_fail(line, dir, "slab count disagrees with heap");
+    }
 
-    return block;
+    size_t partial = 0;
+    for (size_t class = 0; class < NUM_SLAB_CLASSES; class++) {
+        slab_t *prev = NULL;
+        for (slab_t *slab = dir->partial[class]; slab != NULL;
+             slab = slab->next) {
+            if (++partial > num_slabs) {
+                return check_fail(line, dir, "slab lists hold a cycle");
+            }
+            if (find_slab(slab) != slab || slab->prev != prev ||
+                slab->slot_size != (class + 1) * dsize) {
+                return check_fail(line, slab, "slab list holds a bad slab");
+            }
+            word_t all = slab_all_free(slab->slot_count);
+            if (slab->free_slots == 0 || slab->free_slots == all ||
+                (slab->free_slots & ~all) != 0) {
+                return check_fail(line, slab, "bad free slots of slab");
+            }
+            prev = slab;
+        }
+        slab_t *empty = dir->empty[class];
+        if (empty != NULL &&
+            (find_slab(empty) != empty ||
+             empty->slot_size != (class + 1) * dsize ||
+             empty->free_slots != slab_all_free(empty->slot_count))) {
+            return check_fail(line, empty, "bad empty slab");
+        }
+    }
+    return true;
 }
 
 /**
- * @brief
+ * @brief Checks the whole heap of the current arena.
  *
- * <What does this function do?>
- * <What are the function's arguments?>
- * <What is the function's return value?>
- * <Are there any preconditions or postconditions?>
+ * Walks every block from the prologue to the epilogue, counting the free
+ * blocks of each class and the slabs, then checks that the free lists,
+ * the large block tree, the fast bins and the slab lists hold exactly
+ * what the walk found.
  *
- * @param[in] block
- * @param[in] asize
+ * @param[in] line The line mm_checkheap was called from
+ * @return True if the heap is consistent
  */
-static void split_block(block_t *block, size_t asize) {
-    dbg_requires(get_alloc(block));
-    /* TODO: Can you write a precondition about the value of asize? */
+static bool check_heap_full(int line) {
+    size_t free_counts[NUM_SEG_LISTS + 2] = {0};
+    size_t num_alloc = 0;
+    size_t num_slabs = 0;
 
-    size_t block_size = get_size(block);
+    block_t *block = arena->heap_start;
+    while (get_size(block) != 0) {
+        if (!check_block(line, block)) {
+            return false;
+        }
+        size_t size = get_size(block);
+        if (!get_alloc(block)) {
+            size_t index = (size == mini_block_size) ? NUM_SEG_LISTS + 1
+                                                     : find_seg_index(size);
+            free_counts[index]++;
+        } else {
+            num_alloc++;
+        }
 
-    if ((block_size - asize) >= min_block_size) {
-        block_t *block_next;
-        write_block(block, asize, true);
+        slab_t *slab = find_slab(header_to_payload(block));
+        if (slab != NULL) {
+            if ((void *)slab != header_to_payload(block) || !get_alloc(block)) {
+                return check_fail(line, block, "block inside a slab frame");
+            }
+            num_slabs++;
+        }
+        block = find_next(block);
+    }
+    if (block != find_epilogue()) {
+        return check_fail(line, block, "block of size 0 inside the heap");
+    }
 
-        block_next = find_next(block);
-        write_block(block_next, block_size - asize, false);
+    for (size_t index = 0; index < NUM_SEG_LISTS; index++) {
+        if (!check_list(line, arena->seg_lists[index], index,
+                        free_counts[index])) {
+            return false;
+        }
+    }
+    if (!check_list(line, arena->mini_list, NUM_SEG_LISTS + 1,
+                    free_counts[NUM_SEG_LISTS + 1])) {
+        return false;
     }
 
-    dbg_ensures(get_alloc(block));
+    size_t count = 0;
+    size_t height;
+    if (!check_tree(line, arena->large_tree, NULL, NULL, &count,
+                    free_counts[tree_index], &height)) {
+        return false;
+    }
+    if (count != free_counts[tree_index]) {
+        return check_fail(line, arena->large_tree, "free blocks missing "
+                                                   "from tree");
+    }
+
+#ifndef MM_THREAD_SAFE
+    if (!check_fast_bins(line, num_alloc)) {
+        return false;
+    }
+#endif
+    return check_slabs(line, num_slabs);
 }
 
 /**
- * @brief
+ * @brief Checks the blocks of the current arena touched since the last
+ *        check, and the next check_slice blocks of the sweep.
  *
- * <What does this function do?>
- * <What are the function's arguments?>
- * <What is the function's return value?>
- * <Are there any preconditions or postconditions?>
+ * The sweep resumes where the previous check left it, and starts over at
+ * the first block once it reaches the epilogue.
  *
- * @param[in] asize
- * @return
+ * @param[in] line The line mm_checkheap was called from
+ * @return True if every block checked is consistent
  */
-static block_t *find_fit(size_t asize) {
-    block_t *block;
-
-    for (block = heap_start; get_size(block) > 0; block = find_next(block)) {
+static bool check_heap_slice(int line) {
+    size_t touched = min(arena->num_touched, CHECK_TOUCHED);
+    for (size_t i = 0; i < touched; i++) {
+        block_t *block = arena->touched[i];
+        arena->touched[i] = NULL;
+        if (block != NULL && !check_block(line, block)) {
+            return false;
+        }
+    }
+    arena->num_touched = 0;
 
-        if (!(get_alloc(block)) && (asize <= get_size(block))) {
-            return block;
+    block_t *block = arena->check_cursor;
+    for (size_t i = 0; i < check_slice; i++) {
+        if (block == NULL || get_size(block) == 0) {
+            block = arena->heap_start;
+            if (get_size(block) == 0) {
+                break;
+            }
         }
+        if (!check_block(line, block)) {
+            return false;
+        }
+        block = find_next(block);
     }
-    return NULL; // no fit found
+    arena->check_cursor =
+        (block != NULL && get_size(block) != 0) ? block : NULL;
+    return true;
 }
 
 /**
- * @brief
+ * @brief Checks the current arena's heap for consistency.
  *
- * <What does this function do?>
- * <What are the function's arguments?>
- * <What is the function's return value?>
- * <Are there any preconditions or postconditions?>
+ * Every block must lie between the prologue and the epilogue, with a valid
+ * header, a footer matching the header if it is free, and no free
+ * neighbor; and each free block must be on the list or in the tree of its
+ * size class, with consistent links. With CHECK_SLICE 0 the whole heap is
+ * walked, and the free lists, tree, fast bins and slabs are checked to
+ * hold exactly what the walk finds. Otherwise only the blocks touched
+ * since the last call and a slice of a sweep through the heap are checked,
+ * each against its neighbors, along with the list heads.
  *
- * @param[in] line
- * @return
+ * Problems are reported on stderr.
+ *
+ * @param[in] line The line the check was called from, for the report
+ * @return True if no inconsistency was found
+ * @pre The current arena's lock is held, if any
  */
 bool mm_checkheap(int line) {
-    /*
-     * TODO: Delete this comment!
-     *
-     * You will need to write the heap checker yourself.
-     * Please keep modularity in mind when you're writing the heap checker!
-     *
-     * As a filler: one guacamole is equal to 6.02214086 x 10**23 guacas.
-     * One might even call it...  the avocado's number.
-     *
-     * Internal use only: If you mix guacamole on your bibimbap,
-     * do you eat it with a pair of chopsticks, or with a spoon?
-     */
-    dbg_printf("I did not write a heap checker (called at line %d)\n", line);
-    return true;
+    if (arena->heap_start == NULL) {
+        return true;
+    }
+    if (!check_arena_heads(line)) {
+        return false;
+    }
+    return (check_slice == 0) ? check_heap_full(line) : check_heap_slice(line);
+}
+
+_Static_assert(NUM_SEG_LISTS + 2 <= MM_STATS_CLASSES,
+               "mm_stats needs a class per free list, plus two");
+
+/**
+ * @brief Adds the statistics of the current arena to `stats`.
+ * @param[in,out] stats The totals of the arenas added so far
+ */
+static void add_arena_stats(mm_stats_t *stats) {
+    lock_arena();
+    if (arena->heap_start != NULL) {
+        const mm_stats_t *own = &arena->stats;
+        stats->heap_bytes += arena_heapsize();
+        stats->heap_extends += own->heap_extends;
+        stats->heap_trims += own->heap_trims;
+        stats->splits += own->splits;
+        stats->coalesces += own->coalesces;
+        stats->purges += own->purges;
+        stats->consolidations += own->consolidations;
+        for (size_t i = 0; i < MM_STATS_CLASSES; i++) {
+            stats->classes[i].requests += own->classes[i].requests;
+            stats->classes[i].free_blocks += own->classes[i].free_blocks;
+            stats->classes[i].free_bytes += own->classes[i].free_bytes;
+        }
+        if (arena->slabs != NULL) {
+            stats->slabs += arena->slabs->num_slabs;
+        }
+#ifndef MM_THREAD_SAFE
+        if (arena->fast != NULL) {
+            stats->binned_bytes += arena->fast->bytes;
+        }
+#endif
+    }
+    unlock_arena();
 }
 
 /**
- * @brief
+ * @brief Takes a snapshot of the allocator's statistics.
  *
- * <What does this function do?>
- * <What are the function's arguments?>
- * <What is the function's return value?>
- * <Are there any preconditions or postconditions?>
+ * The counters are kept as the heap changes, so a snapshot costs a lock
+ * and a few additions per arena, and no walk of the heap or free lists.
+ * Each arena is added under its own lock, so the snapshot is consistent
+ * per arena but not across arenas.
  *
- * @return
+ * @param[out] stats Where to store the snapshot
  */
-bool mm_init(void) {
-    // Create the initial empty heap
-    word_t *start = (word_t *)(mem_sbrk(2 * wsize));
+void mm_stats(mm_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->huge_blocks = __atomic_load_n(&huge_blocks, __ATOMIC_RELAXED);
+    stats->huge_bytes = __atomic_load_n(&huge_bytes, __ATOMIC_RELAXED);
 
-    if (start == (void *)-1) {
-        return false;
+#ifdef MM_THREAD_SAFE
+    arena_t *saved = arena;
+    arena = &main_arena;
+    lock_arena();
+    // Count the caller's own requests, which it would flush only later
+    flush_requests();
+    unlock_arena();
+    add_arena_stats(stats);
+    pthread_mutex_lock(&arenas_lock);
+    for (size_t index = 1; index < MAX_ARENAS; index++) {
+        if (arenas[index] != NULL) {
+            arena = arenas[index];
+            add_arena_stats(stats);
+        }
     }
+    pthread_mutex_unlock(&arenas_lock);
+    arena = saved;
+#else
+    add_arena_stats(stats);
+#endif
 
-    /*
-     * TODO: delete or replace this comment once you've thought about it.
-     * Think about why we need a heap prologue and epilogue. Why do
-     * they correspond to a block footer and header respectively?
-     */
-
-    start[0] = pack(0, true); // Heap prologue (block footer)
-    start[1] = pack(0, true); // Heap epilogue (block header)
+    stats->num_classes = NUM_SEG_LISTS + 2;
+    stats->classes[0].max_size = mini_block_size;
+    for (size_t index = 0; index < NUM_SEG_LISTS; index++) {
+        stats->classes[index + 1].max_size = seg_class_max[index];
+    }
+    stats->classes[tree_index + 1].max_size = SIZE_MAX;
+    for (size_t i = 0; i < stats->num_classes; i++) {
+        stats->free_blocks += stats->classes[i].free_blocks;
+        stats->free_bytes += stats->classes[i].free_bytes;
+    }
+}
 
-    // Heap starts with first "block header", currently the epilogue
-    heap_start = (block_t *)&(start[1]);
+/**
+ * @brief Initializes the allocator, discarding any earlier heap.
+ *
+ * Creates the heap of the main arena, with its prologue, epilogue and a
+ * first free block. The thread-safe build also destroys the regions of
+ * the other arenas, chooses how many arenas to use, and empties the
+ * calling thread's cache. Huge blocks of the old heap are forgotten
+ * without being unmapped.
+ *
+ * @return True on success, false if the heap could not be created
+ * @pre No other thread is using the allocator
+ */
+bool mm_init(void) {
+#ifdef MM_THREAD_SAFE
+    // Arenas in regions belonged to the old heap
+    for (size_t index = 1; index < MAX_ARENAS; index++) {
+        if (arenas[index] != NULL) {
+            mem_region_destroy(arenas[index]->region);
+            arenas[index] = NULL;
+        }
+    }
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t count = (NUM_ARENAS > 0) ? NUM_ARENAS
+                   : (cpus > 0)     ? (size_t)cpus
+                                    : 1;
+    arena_count = (count < MAX_ARENAS) ? count : MAX_ARENAS;
+    next_arena = 0;
+    thread_arena = NULL;
+    arena = &main_arena;
+    main_arena.remote_frees = NULL;
 
-    // Extend the empty heap with a free block of chunksize bytes
-    if (extend_heap(chunksize) == NULL) {
-        return false;
+    // Blocks cached by the calling thread belonged to the old heap
+    for (size_t index = 0; index < TCACHE_BINS; index++) {
+        tcache.bins[index] = NULL;
+        tcache.counts[index] = 0;
     }
+    for (size_t i = 0; i < MM_STATS_CLASSES; i++) {
+        tcache.requests[i] = 0;
+    }
+    tcache.pending = 0;
+#endif
+    huge_blocks = 0;
+    huge_bytes = 0;
 
-    return true;
+    return init_arena();
 }
 
 /**
- * @brief
+ * @brief Allocates a block with a payload of at least `size` bytes.
  *
- * <What does this function do?>
- * <What are the function's arguments?>
- * <What is the function's return value?>
- * <Are there any preconditions or postconditions?>
+ * Huge requests get a mapping of their own, and small ones a slab slot
+ * where that packs them more tightly. Others reuse a recently freed block
+ * of exactly their size, from the fast bins or, in the thread-safe build,
+ * the thread's cache, before the heap is searched or extended.
  *
- * @param[in] size
- * @return
+ * @param[in] size The payload size in bytes
+ * @return The payload of the block, aligned to dsize, or NULL if `size`
+ *         is 0 or no memory could be obtained
  */
 void *malloc(size_t size) {
-    dbg_requires(mm_checkheap(__LINE__));
+    // Ignore spurious request
+    if (size == 0) {
+        return NULL;
+    }
 
-    size_t asize;      // Adjusted block size
-    size_t extendsize; // Amount to extend heap if no fit is found
-    block_t *block;
-    void *bp = NULL;
+    // Adjust block size to include overhead and to meet alignment requirements
+    size_t asize = adjust_size(size);
+    count_request(asize, 1);
 
-    // Initialize heap if it isn't initialized
-    if (heap_start == NULL) {
-        if (!(mm_init())) {
-            dbg_printf("Problem initializing heap. Likely due to sbrk");
-            return NULL;
+    // Give huge requests a mapping of their own, falling back to the heap
+    if (asize >= huge_threshold) {
+        block_t *huge = alloc_huge(asize, dsize);
+        if (huge != NULL) {
+            return header_to_payload(huge);
         }
     }
 
-    // Ignore spurious request
-    if (size == 0) {
-        dbg_ensures(mm_checkheap(__LINE__));
-        return bp;
+    // Pack small sizes that fit slab slots more tightly than blocks
+    void *slot = slab_malloc(size);
+    if (slot != NULL) {
+        return slot;
     }
 
-    // Adjust block size to include overhead and to meet alignment requirements
-    asize = round_up(size + dsize, dsize);
+#ifdef MM_THREAD_SAFE
+    // Reuse a block this thread freed recently, without taking a lock
+    block_t *cached = tcache_get(asize);
+#else
+    // Reuse a block freed recently, without splitting it off a free block
+    block_t *cached = fast_get(asize);
+#endif
+    if (cached != NULL) {
+        return header_to_payload(cached);
+    }
 
-    // Search the free list for a fit
-    block = find_fit(asize);
+    block_t *block = heap_malloc(asize, dsize, 0);
+    return (block != NULL) ? header_to_payload(block) : NULL;
+}
 
-    // If no fit is found, request more memory, and then and place the block
-    if (block == NULL) {
-        // Always request at least chunksize
-        extendsize = max(asize, chunksize);
-        block = extend_heap(extendsize);
-        // extend_heap returns an error
-        if (block == NULL) {
-            return bp;
-        }
+/**
+ * @brief Frees a block allocated by malloc, calloc, realloc or memalign.
+ *
+ * Slab slots go back to their slab, and huge blocks to the memory system.
+ * Other blocks are cached or binned if small, and otherwise coalesced
+ * into the free lists.
+ *
+ * @param[in] bp The payload of an allocated block, or NULL, which is
+ *               ignored
+ */
+void free(void *bp) {
+    if (bp == NULL) {
+        return;
     }
 
-    // The block should be marked as free
-    dbg_assert(!get_alloc(block));
-
-    // Mark block as allocated
-    size_t block_size = get_size(block);
-    write_block(block, block_size, true);
+    // Slab slots have no header to look at
+    slab_t *slab = find_slab(bp);
+    if (slab != NULL) {
+        slab_free(slab, bp);
+        return;
+    }
 
-    // Try to split the block if too large
-    split_block(block, asize);
+    // Other threads may update the header flags concurrently, so the
+    // header is loaded once, for both the huge flag and the size
+    block_t *block = payload_to_header(bp);
+    word_t header = load_header(block);
 
-    bp = header_to_payload(block);
+    // Huge blocks go straight back to the memory system
+    if ((header & huge_mask) != 0) {
+        free_huge(block);
+        return;
+    }
 
-    dbg_ensures(mm_checkheap(__LINE__));
-    return bp;
+    heap_free(block, extract_size(header));
 }
 
 /**
- * @brief
+ * @brief Frees a block whose requested size the caller knows, as in C23.
  *
- * <What does this function do?>
- * <What are the function's arguments?>
- * <What is the function's return value?>
- * <Are there any preconditions or postconditions?>
+ * The header stays the only record of the block size, since splitting,
+ * alignment and realloc in place can all leave a block larger than
+ * adjust_size(size), and every block in a fast bin or tcache bin must have
+ * exactly the size of its bin. What `size` does tell is that only small
+ * requests live in slabs, so larger blocks skip the slab lookup. The
+ * header is then read only once, as in free.
  *
- * @param[in] bp
+ * @param[in] bp The payload of an allocated block, or NULL
+ * @param[in] size The size passed to the malloc, calloc or realloc call
+ *                 that returned `bp`
  */
-void free(void *bp) {
-    dbg_requires(mm_checkheap(__LINE__));
-
+void free_sized(void *bp, size_t size) {
     if (bp == NULL) {
         return;
     }
 
+    dbg_requires(size <= malloc_usable_size(bp));
+
+    // Only payloads of up to slab_max_slot bytes ever live in slabs
+    slab_t *slab = (size <= slab_max_slot) ? find_slab(bp) : NULL;
+    if (slab != NULL) {
+        slab_free(slab, bp);
+        return;
+    }
+
     block_t *block = payload_to_header(bp);
-    size_t size = get_size(block);
+    word_t header = load_header(block);
+    if ((header & huge_mask) != 0) {
+        free_huge(block);
+        return;
+    }
 
-    // The block should be marked as allocated
-    dbg_assert(get_alloc(block));
+    heap_free(block, extract_size(header));
+}
+
+/**
+ * @brief Allocates `n` blocks of at least `size` bytes each at once.
+ *
+ * The blocks are carved out of a few large blocks under a single lock, so
+ * they lie next to each other in the heap in the order they are returned.
+ * Huge blocks are allocated one by one, since each needs a mapping of its
+ * own anyway.
+ *
+ * @param[in] size The minimum size of each block in bytes
+ * @param[in] n The number of blocks to allocate
+ * @param[out] out Where to store the payloads, `n` of them
+ * @return The number of blocks allocated, which is less than `n` only if
+ *         `size` is 0 or no more memory could be obtained
+ */
+size_t malloc_batch(size_t size, size_t n, void **out) {
+    if (size == 0) {
+        return 0;
+    }
 
-    // Mark the block as free
-    write_block(block, size, false);
+    size_t asize = adjust_size(size);
+    size_t count = 0;
+    if (asize >= huge_threshold) {
+        while (count < n && (out[count] = malloc(size)) != NULL) {
+            count++;
+        }
+        return count;
+    }
 
-    // Try to coalesce the block with its neighbors
-    coalesce_block(block);
+#ifdef MM_THREAD_SAFE
+    arena = home_arena();
+#endif
+    count = arena_malloc_batch(asize, n, out);
 
-    dbg_ensures(mm_checkheap(__LINE__));
+#ifdef MM_THREAD_SAFE
+    if (count < n && arena != &main_arena) {
+        arena = &main_arena;
+        count += arena_malloc_batch(asize, n - count, out + count);
+    }
+#endif
+    count_request(asize, count);
+    return count;
 }
 
 /**
- * @brief
+ * @brief Frees `n` blocks at once.
  *
- * <What does this function do?>
- * <What are the function's arguments?>
- * <What is the function's return value?>
- * <Are there any preconditions or postconditions?>
+ * The payloads are sorted by address, unless they already are, so that
+ * each run of blocks that follow each other in the heap, such as those
+ * from one malloc_batch call, is freed as a single block.
  *
- * @param[in] ptr
- * @param[in] size
- * @return
+ * @param[in,out] ptrs The payloads to free, any of which may be NULL;
+ *                     they are left sorted by address
+ * @param[in] n The number of payloads
+ */
+void free_batch(void **ptrs, size_t n) {
+    for (size_t i = 1; i < n; i++) {
+        if ((uintptr_t)ptrs[i - 1] > (uintptr_t)ptrs[i]) {
+            qsort(ptrs, n, sizeof(void *), compare_payloads);
+            break;
+        }
+    }
+
+    size_t i = 0;
+    while (i < n) {
+        if (ptrs[i] == NULL) {
+            i++;
+            continue;
+        }
+
+        slab_t *slab = find_slab(ptrs[i]);
+        if (slab != NULL) {
+            slab_free(slab, ptrs[i++]);
+            continue;
+        }
+
+        block_t *block = payload_to_header(ptrs[i++]);
+        if (is_huge(block)) {
+            free_huge(block);
+            continue;
+        }
+
+        // Extend the run over the blocks that directly follow it
+        size_t size = extract_size(load_header(block));
+        while (i < n && (char *)ptrs[i] == (char *)block + size + wsize) {
+            size += extract_size(load_header(payload_to_header(ptrs[i++])));
+        }
+
+#ifdef MM_THREAD_SAFE
+        release_run(block, size);
+#else
+        dbg_requires(mm_checkheap(__LINE__));
+        free_run(block, size);
+        dbg_ensures(mm_checkheap(__LINE__));
+        audit_heap(__LINE__);
+#endif
+    }
+}
+
+/**
+ * @brief Changes the size of an allocated block.
+ *
+ * Shrinking splits the tail of the block off into a free block, and
+ * growing first tries to absorb a free successor, so in both cases the
+ * payload stays where it is. Only when neither works is a new block
+ * allocated, the payload copied, and the old block freed.
+ *
+ * @param[in] ptr The payload of an allocated block, or NULL
+ * @param[in] size The new payload size in bytes
+ * @return The payload of the resized block, which may differ from `ptr`,
+ *         or NULL if `size` is 0 or no memory could be obtained, in which
+ *         case a non-zero request leaves the original block untouched
  */
 void *realloc(void *ptr, size_t size) {
     block_t *block = payload_to_header(ptr);
@@ -726,6 +4100,24 @@ void *realloc(void *ptr, size_t size) {
         return malloc(size);
     }
 
+    // Try to resize the block without moving the payload
+    size_t asize = adjust_size(size);
+    slab_t *slab = find_slab(ptr);
+    bool in_place;
+    if (slab != NULL) {
+        // A slab slot keeps its payload for as long as the payload fits
+        in_place = (size <= slab->slot_size);
+    } else if (is_huge(block)) {
+        // A huge block keeps its mapping while it stays more than half full
+        in_place = (asize <= get_size(block) && asize > get_size(block) / 2);
+    } else {
+        in_place = resize_block(block, asize);
+    }
+    if (in_place) {
+        count_request(asize, 1);
+        return ptr;
+    }
+
     // Otherwise, proceed with reallocation
     newptr = malloc(size);
 
@@ -735,7 +4127,7 @@ void *realloc(void *ptr, size_t size) {
     }
 
     // Copy the old data
-    copysize = get_payload_size(block); // gets size of old payload
+    copysize = malloc_usable_size(ptr); // gets size of old payload
     if (size < copysize) {
         copysize = size;
     }
@@ -748,38 +4140,162 @@ void *realloc(void *ptr, size_t size) {
 }
 
 /**
- * @brief
+ * @brief Allocates a zeroed array of `elements` elements of `size` bytes.
  *
- * <What does this function do?>
- * <What are the function's arguments?>
- * <What is the function's return value?>
- * <Are there any preconditions or postconditions?>
+ * Only the bytes that may have been written before are cleared. Huge
+ * blocks come from fresh mappings, and a heap block taken from space the
+ * heap has just grown into is cleared only up to the fresh mark, so large
+ * arrays are neither written twice nor faulted in ahead of their use.
  *
- * @param[in] elements
- * @param[in] size
- * @return
+ * @param[in] elements The number of elements
+ * @param[in] size The size of each element in bytes
+ * @return The zeroed payload, or NULL if the total size is 0, overflows,
+ *         or no memory could be obtained
  */
 void *calloc(size_t elements, size_t size) {
     void *bp;
-    size_t asize = elements * size;
+    size_t total = elements * size;
 
-    if (elements == 0) {
+    if (elements == 0 || total == 0) {
         return NULL;
     }
-    if (asize / elements != size) {
+    if (total / elements != size) {
         // Multiplication overflowed
         return NULL;
     }
 
-    bp = malloc(asize);
-    if (bp == NULL) {
+    size_t asize = adjust_size(total);
+    count_request(asize, 1);
+
+    // A new mapping is normally zero-filled already
+    if (asize >= huge_threshold) {
+        block_t *huge = alloc_huge(asize, dsize);
+        if (huge != NULL) {
+            bp = header_to_payload(huge);
+            if (!mem_map_zeroed()) {
+                memset(bp, 0, total);
+            }
+            return bp;
+        }
+    }
+
+    // Slots and recently freed blocks have been written, so clear them
+    bp = slab_malloc(total);
+#ifdef MM_THREAD_SAFE
+    block_t *cached = (bp == NULL) ? tcache_get(asize) : NULL;
+#else
+    block_t *cached = (bp == NULL) ? fast_get(asize) : NULL;
+#endif
+    if (cached != NULL) {
+        bp = header_to_payload(cached);
+    }
+    if (bp != NULL) {
+        memset(bp, 0, total);
+        return bp;
+    }
+
+    // Skip the part of a heap block that has never been written
+    block_t *block = heap_malloc(asize, dsize, total);
+    return (block != NULL) ? header_to_payload(block) : NULL;
+}
+
+/**
+ * @brief Allocates a block whose payload is aligned to `alignment`.
+ *
+ * Alignments up to dsize are what malloc provides anyway. Larger ones are
+ * carved out of a free block by alloc_aligned_block, or for huge requests
+ * and alignments up to a page, placed in a mapping of their own.
+ *
+ * @param[in] alignment The alignment of the payload, a power of two
+ * @param[in] size The payload size in bytes
+ * @return The aligned payload, or NULL if `size` is 0, the alignment is
+ *         not a power of two (setting errno to EINVAL), or no memory could
+ *         be obtained
+ */
+void *memalign(size_t alignment, size_t size) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (alignment <= dsize) {
+        return malloc(size);
+    }
+    if (size == 0) {
         return NULL;
     }
 
-    // Initialize all bits to 0
-    memset(bp, 0, asize);
+    size_t asize = adjust_size(size);
+    if (asize > SIZE_MAX - alignment) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    count_request(asize, 1);
+
+    if (asize + alignment >= huge_threshold && alignment <= mem_pagesize()) {
+        block_t *huge = alloc_huge(asize, alignment);
+        if (huge != NULL) {
+            return header_to_payload(huge);
+        }
+    }
+
+    block_t *block = heap_malloc(asize, alignment, 0);
+    return (block != NULL) ? header_to_payload(block) : NULL;
+}
+
+/**
+ * @brief Allocates a block whose payload is aligned to `alignment`, as in
+ *        C11.
+ * @param[in] alignment The alignment of the payload, a power of two
+ * @param[in] size The payload size in bytes
+ * @return The aligned payload, or NULL on failure
+ */
+void *aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+/**
+ * @brief Allocates a block whose payload is aligned to `alignment`, as in
+ *        POSIX.
+ * @param[out] memptr Where to store the aligned payload
+ * @param[in] alignment The alignment of the payload, a power of two and a
+ *                      multiple of sizeof(void *)
+ * @param[in] size The payload size in bytes
+ * @return 0 on success, with NULL stored for a size of 0; EINVAL for a
+ *         bad alignment, or ENOMEM if no memory could be obtained, leaving
+ *         `*memptr` untouched
+ */
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    if (alignment == 0 || alignment % sizeof(void *) != 0 ||
+        (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    void *bp = memalign(alignment, size);
+    if (bp == NULL && size != 0) {
+        return ENOMEM;
+    }
+    *memptr = bp;
+    return 0;
+}
 
-    return bp;
+/**
+ * @brief Returns how many bytes of an allocated block the caller may use.
+ *
+ * This is the whole payload of the block, which can exceed the size that
+ * was asked for.
+ *
+ * @param[in] bp The payload of an allocated block, or NULL
+ * @return The payload size in bytes, or 0 for NULL
+ */
+size_t malloc_usable_size(void *bp) {
+    if (bp == NULL) {
+        return 0;
+    }
+    slab_t *slab = find_slab(bp);
+    if (slab != NULL) {
+        return slab->slot_size;
+    }
+    // Other threads may update the header flags concurrently
+    return extract_size(load_header(payload_to_header(bp))) - wsize;
 }
 
 /*
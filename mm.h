@@ -16,6 +16,13 @@ extern void *mm_malloc(size_t size);
 extern void mm_free(void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 extern void *mm_calloc(size_t nmemb, size_t size);
+extern void *mm_memalign(size_t alignment, size_t size);
+extern void *mm_aligned_alloc(size_t alignment, size_t size);
+extern int mm_posix_memalign(void **memptr, size_t alignment, size_t size);
+extern void mm_free_sized(void *ptr, size_t size);
+extern size_t mm_malloc_usable_size(void *ptr);
+extern size_t mm_malloc_batch(size_t size, size_t n, void **out);
+extern void mm_free_batch(void **ptrs, size_t n);
 
 #else
 
@@ -59,6 +66,78 @@ extern void *realloc(void *ptr, size_t size);
  * @return A pointer to the first element of the array.
  */
 extern void *calloc(size_t nmemb, size_t size);
+
+/**
+ * @brief  Allocate memory in the heap of at least `size` bytes, aligned
+ *         to `alignment` bytes.
+ *
+ * @param[in] alignment  The alignment of the allocated bytes, a power of two.
+ * @param[in] size  The minimum size of bytes to allocate.
+ *
+ * @return  A pointer to the beginning of the allocated bytes.
+ */
+extern void *memalign(size_t alignment, size_t size);
+
+/**
+ * @brief  Allocate memory in the heap of at least `size` bytes, aligned
+ *         to `alignment` bytes (C11).
+ *
+ * @param[in] alignment  The alignment of the allocated bytes, a power of two.
+ * @param[in] size  The minimum size of bytes to allocate.
+ *
+ * @return  A pointer to the beginning of the allocated bytes.
+ */
+extern void *aligned_alloc(size_t alignment, size_t size);
+
+/**
+ * @brief  Allocate memory in the heap of at least `size` bytes, aligned
+ *         to `alignment` bytes (POSIX).
+ *
+ * @param[out] memptr  Where to store a pointer to the allocated bytes.
+ * @param[in] alignment  The alignment of the allocated bytes, a power of two
+ *                       and a multiple of sizeof(void *).
+ * @param[in] size  The minimum size of bytes to allocate.
+ *
+ * @return  0 on success, or EINVAL or ENOMEM on failure.
+ */
+extern int posix_memalign(void **memptr, size_t alignment, size_t size);
+
+/**
+ * @brief  Marks an allocated block of known size as free (C23).
+ *
+ * @param[in] ptr  A pointer to the beginning of the allocated payload.
+ * @param[in] size  The size requested when the block was allocated.
+ */
+extern void free_sized(void *ptr, size_t size);
+
+/**
+ * @brief  Get the number of usable bytes in an allocated block.
+ *
+ * @param[in] ptr  A pointer to the beginning of the allocated payload.
+ *
+ * @return  The size of the payload, at least the size requested, or 0 if
+ *          `ptr` is NULL.
+ */
+extern size_t malloc_usable_size(void *ptr);
+
+/**
+ * @brief  Allocate `n` blocks of at least `size` bytes each at once.
+ *
+ * @param[in] size  The minimum size of bytes to allocate for each block.
+ * @param[in] n  The number of blocks to allocate.
+ * @param[out] out  An array of `n` pointers to fill with the blocks.
+ *
+ * @return  The number of blocks allocated, `n` unless memory ran out.
+ */
+extern size_t malloc_batch(size_t size, size_t n, void **out);
+
+/**
+ * @brief  Marks `n` allocated blocks as free at once.
+ *
+ * @param[in,out] ptrs  The blocks to free, which are sorted in place.
+ * @param[in] n  The number of blocks.
+ */
+extern void free_batch(void **ptrs, size_t n);
 #endif
 
 /**
@@ -78,4 +157,69 @@ extern bool mm_init(void);
  */
 extern bool mm_checkheap(int line);
 
+/** @brief  Maximum number of size classes reported by mm_stats. */
+#define MM_STATS_CLASSES 16
+
+/**
+ * @brief  Statistics of one size class of blocks.
+ */
+typedef struct {
+    /** @brief  Largest block size in the class, or SIZE_MAX for the last. */
+    size_t max_size;
+    /** @brief  Allocation requests whose block size falls in the class. */
+    size_t requests;
+    /** @brief  Free blocks of the class on the free lists. */
+    size_t free_blocks;
+    /** @brief  Total size of those free blocks, in bytes. */
+    size_t free_bytes;
+} mm_class_stats_t;
+
+/**
+ * @brief  A snapshot of the allocator's state, summed over all arenas.
+ *
+ * Event counts and requests accumulate from the last mm_init.
+ */
+typedef struct {
+    /** @brief  Total size of the heaps, in bytes. */
+    size_t heap_bytes;
+    /** @brief  Blocks that live in mappings of their own. */
+    size_t huge_blocks;
+    /** @brief  Total size of those mappings, in bytes. */
+    size_t huge_bytes;
+    /** @brief  Free blocks on the free lists, over all classes. */
+    size_t free_blocks;
+    /** @brief  Total size of those free blocks, in bytes. */
+    size_t free_bytes;
+    /** @brief  Bytes of freed blocks waiting in fast bins, uncoalesced. */
+    size_t binned_bytes;
+    /** @brief  Slabs of small slots in the heaps. */
+    size_t slabs;
+    /** @brief  Number of times a heap was extended. */
+    size_t heap_extends;
+    /** @brief  Number of times a heap was shrunk. */
+    size_t heap_trims;
+    /** @brief  Number of blocks split in two. */
+    size_t splits;
+    /** @brief  Number of blocks merged with free neighbors. */
+    size_t coalesces;
+    /** @brief  Number of free blocks whose pages were purged. */
+    size_t purges;
+    /** @brief  Number of times the fast bins were coalesced. */
+    size_t consolidations;
+    /** @brief  Number of entries of `classes` in use. */
+    size_t num_classes;
+    /** @brief  Statistics by size class, smallest first. */
+    mm_class_stats_t classes[MM_STATS_CLASSES];
+} mm_stats_t;
+
+/**
+ * @brief  Take a snapshot of the allocator's statistics.
+ *
+ * In a thread-safe build, the requests a thread served from its own cache
+ * are counted once it next takes its arena's lock.
+ *
+ * @param[out] stats  Where to store the snapshot.
+ */
+extern void mm_stats(mm_stats_t *stats);
+
 #endif /* mm.h */
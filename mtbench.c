@@ -0,0 +1,299 @@
+/*
+ * mtbench.c - Multithreaded scaling benchmark for the thread-safe build of
+ * the allocator in mm.c
+ *
+ * Runs the same random malloc/free workload on 1, 2, 4, ... up to N
+ * threads at once, each thread working on its own set of live blocks, and
+ * reports the aggregate throughput and the speedup over a single thread.
+ * With -p, threads instead run in producer/consumer pairs, where every
+ * block one thread allocates is freed by the other.
+ * mm.c must be compiled with -DMM_THREAD_SAFE; see the mtbench target in
+ * the Makefile.
+ */
+
+// POSIX extensions used: clock_gettime
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+/**********************
+ * Constants and macros
+ **********************/
+
+#ifndef MM_THREAD_SAFE
+#error "mtbench needs mm.c compiled with -DMM_THREAD_SAFE"
+#endif
+
+#define NUM_SLOTS 1024            /* live blocks per thread */
+#define DEFAULT_OPS 1000000       /* malloc or free calls per thread */
+#define DEFAULT_MAX_SIZE 256      /* largest payload requested (bytes) */
+#define RING_SIZE 1024            /* blocks in flight per producer/consumer */
+
+/* Single-producer, single-consumer queue of blocks */
+typedef struct {
+    unsigned char *slots[RING_SIZE];
+    unsigned long head; /* written only by the producer */
+    unsigned long tail; /* written only by the consumer */
+} ring_t;
+
+/* Arguments and result of one worker thread */
+typedef struct {
+    unsigned int id;
+    unsigned long ops;
+    size_t max_size;
+    ring_t *ring; /* shared with the partner thread in pair mode */
+    bool ok;
+} worker_t;
+
+/* Returns a pseudo-random number (xorshift64) */
+static uint64_t next_random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+/* Returns the current time in seconds */
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* Returns a random request size, skewed towards small requests */
+static size_t random_size(uint64_t r, size_t max_size) {
+    size_t limit = ((r >> 32) & 3) ? 64 : max_size;
+    return 1 + (size_t)((r >> 16) % limit);
+}
+
+/*
+ * Worker thread: repeatedly picks a random slot, freeing the block in it
+ * if there is one and otherwise allocating a block of random size. Each block
+ * is stamped with its slot number, and the stamp is checked on free.
+ */
+static void *worker(void *arg) {
+    worker_t *w = arg;
+    unsigned char *slots[NUM_SLOTS] = {NULL};
+    uint64_t state = 0x9E3779B97F4A7C15ULL * (w->id + 1);
+
+    w->ok = true;
+    for (unsigned long i = 0; i < w->ops; i++) {
+        uint64_t r = next_random(&state);
+        size_t slot = (size_t)(r % NUM_SLOTS);
+        if (slots[slot] != NULL) {
+            if (slots[slot][0] != (unsigned char)slot)
+                w->ok = false;
+            mm_free(slots[slot]);
+            slots[slot] = NULL;
+        } else {
+            slots[slot] = mm_malloc(random_size(r, w->max_size));
+            if (slots[slot] == NULL) {
+                w->ok = false;
+                break;
+            }
+            slots[slot][0] = (unsigned char)slot;
+        }
+    }
+    for (size_t slot = 0; slot < NUM_SLOTS; slot++)
+        mm_free(slots[slot]);
+    return NULL;
+}
+
+/*
+ * Producer thread in pair mode: allocates blocks and queues them for its
+ * partner to free. A NULL block marks the end of the queue.
+ */
+static void *producer(void *arg) {
+    worker_t *w = arg;
+    ring_t *ring = w->ring;
+    uint64_t state = 0x9E3779B97F4A7C15ULL * (w->id + 1);
+
+    w->ok = true;
+    for (unsigned long i = 0; i <= w->ops; i++) {
+        unsigned char *p = NULL;
+        if (i < w->ops) {
+            uint64_t r = next_random(&state);
+            p = mm_malloc(random_size(r, w->max_size));
+            if (p == NULL) {
+                w->ok = false;
+            } else {
+                p[0] = (unsigned char)i;
+            }
+        }
+        while (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) ==
+               RING_SIZE)
+            sched_yield();
+        ring->slots[ring->head % RING_SIZE] = p;
+        __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+        if (p == NULL)
+            break;
+    }
+    return NULL;
+}
+
+/* Consumer thread in pair mode: frees the blocks its partner allocated */
+static void *consumer(void *arg) {
+    worker_t *w = arg;
+    ring_t *ring = w->ring;
+
+    w->ok = true;
+    for (unsigned long i = 0;; i++) {
+        while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail)
+            sched_yield();
+        unsigned char *p = ring->slots[ring->tail % RING_SIZE];
+        __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+        if (p == NULL)
+            break;
+        if (p[0] != (unsigned char)i)
+            w->ok = false;
+        mm_free(p);
+    }
+    return NULL;
+}
+
+/*
+ * Runs the workload on `nthreads` threads at once and returns the elapsed
+ * time in seconds, or a negative value on error
+ */
+static double run(unsigned int nthreads, unsigned long ops, size_t max_size,
+                  bool pairs) {
+    pthread_t *threads = calloc(nthreads, sizeof(pthread_t));
+    worker_t *workers = calloc(nthreads, sizeof(worker_t));
+    ring_t *rings = calloc(nthreads / 2 + 1, sizeof(ring_t));
+    bool ok = threads != NULL && workers != NULL && rings != NULL;
+
+    mem_reset_brk();
+    if (ok && !mm_init()) {
+        fprintf(stderr, "mm_init failed\n");
+        ok = false;
+    }
+
+    double start = now();
+    unsigned int started = 0;
+    for (; ok && started < nthreads; started++) {
+        workers[started].id = started;
+        workers[started].ops = ops;
+        workers[started].max_size = max_size;
+        workers[started].ring = &rings[started / 2];
+        void *(*func)(void *) = !pairs              ? worker
+                                : (started % 2 == 0) ? producer
+                                                     : consumer;
+        if (pthread_create(&threads[started], NULL, func,
+                           &workers[started]) != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            ok = false;
+            break;
+        }
+    }
+    for (unsigned int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+        if (!workers[i].ok) {
+            fprintf(stderr, "thread %u: allocation failed or corrupted\n", i);
+            ok = false;
+        }
+    }
+    double elapsed = now() - start;
+
+    free(threads);
+    free(workers);
+    free(rings);
+    return ok ? elapsed : -1.0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-hp] [-t <threads>] [-n <ops>] [-s <size>]\n", prog);
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-p         Run producer/consumer pairs: one thread "
+                    "of each pair\n"
+                    "\t           allocates, the other frees.\n");
+    fprintf(stderr, "\t-t <n>     Scale up to <n> threads "
+                    "(default: online CPUs).\n");
+    fprintf(stderr, "\t-n <n>     Allocator calls per thread "
+                    "(default: %d).\n",
+            DEFAULT_OPS);
+    fprintf(stderr, "\t-s <n>     Largest request in bytes (default: %d).\n",
+            DEFAULT_MAX_SIZE);
+}
+
+/* Parses a positive integer option, or exits with a usage message */
+static unsigned long parse_or_usage(const char *arg, const char *prog) {
+    char *end;
+    unsigned long val = strtoul(arg, &end, 10);
+    if (*arg == '\0' || *end != '\0' || val == 0) {
+        usage(prog);
+        exit(1);
+    }
+    return val;
+}
+
+int main(int argc, char **argv) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned long max_threads = cpus > 0 ? (unsigned long)cpus : 1;
+    unsigned long ops = DEFAULT_OPS;
+    size_t max_size = DEFAULT_MAX_SIZE;
+    bool pairs = false;
+    int c;
+
+    while ((c = getopt(argc, argv, "hpt:n:s:")) != -1) {
+        switch (c) {
+        case 'p':
+            pairs = true;
+            break;
+        case 't':
+            max_threads = parse_or_usage(optarg, argv[0]);
+            break;
+        case 'n':
+            ops = parse_or_usage(optarg, argv[0]);
+            break;
+        case 's':
+            max_size = parse_or_usage(optarg, argv[0]);
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(0);
+        default:
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    mem_init(false);
+
+    printf("%8s %10s %12s %8s\n", "threads", "secs", "Kops/sec", "speedup");
+    double base = 0.0;
+    /* Double the thread count each round, finishing at max_threads; pairs
+     * need an even number of threads */
+    unsigned long first = pairs ? 2 : 1;
+    if (pairs)
+        max_threads += max_threads % 2;
+    for (unsigned long n = first; n <= max_threads;
+         n = (n < max_threads && n * 2 > max_threads) ? max_threads : n * 2) {
+        double secs = run((unsigned int)n, ops, max_size, pairs);
+        if (secs < 0) {
+            mem_deinit();
+            return 1;
+        }
+        double kops = (double)n * (double)ops / secs / 1e3;
+        if (n == first)
+            base = kops;
+        printf("%8lu %10.3f %12.0f %8.2f\n", n, secs, kops, kops / base);
+    }
+
+    mem_deinit();
+    return 0;
+}
@@ -0,0 +1,40 @@
+/*
+ * sizeclasses.h - Size classes of the segregated free lists of mm.c
+ *
+ * Generated by sizeclasses.pl from 20 traces, with 551455
+ * requests for blocks of up to 4096 bytes. Do not edit.
+ */
+
+#ifndef SIZECLASSES_H__
+#define SIZECLASSES_H__ 1
+
+/** @brief Number of segregated free lists */
+#define NUM_SEG_LISTS 8
+
+/** @brief Largest block size of each list (bytes) */
+static const size_t seg_class_max[NUM_SEG_LISTS] = {
+    32, 48, 64, 144, 256, 560, 1680, 4096,
+};
+
+/** @brief Size class of each block size up to 4096, indexed by size / 16 */
+static const unsigned char seg_class_table[257] = {
+    0, 0, 0, 1, 2, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4,
+    4, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7,
+};
+
+#endif /* sizeclasses.h */
@@ -0,0 +1,153 @@
+#!/usr/bin/perl
+use Getopt::Std;
+
+##############################################################################
+#
+# This program chooses the size classes of the segregated free lists of
+# mm.c from the request sizes of a set of trace files. It writes a header
+# that defines NUM_SEG_LISTS, the largest block size of each list, and a
+# table that maps a block size to its list in constant time.
+#
+# Block sizes are computed as mm.c's adjust_size does. Mini blocks have a
+# list of their own, and blocks larger than the last list go to the large
+# block tree, so only the sizes in between are counted. The boundaries are
+# placed so that each list serves about the same number of requests: a
+# size that makes up a large share of the requests gets a list to itself,
+# in which any block is an exact fit.
+#
+##############################################################################
+
+sub usage
+{
+    print STDERR "$_[0]\n";
+    print STDERR "Usage: $0 [-h] [-n LISTS] [-m MAX] [-o OUTFILE] TRACE...\n";
+    print STDERR "Options:\n";
+    print STDERR "  -h          Print this message\n";
+    print STDERR "  -n LISTS    Number of segregated lists (default 8)\n";
+    print STDERR "  -m MAX      Largest block size kept in a list " .
+        "(default 4096)\n";
+    print STDERR "  -o OUTFILE  Specify output file (default stdout)\n";
+    exit(0);
+}
+
+# Block layout of mm.c
+$wsize = 8;
+$dsize = 16;
+$mini_block_size = 16;
+
+getopts('hn:m:o:');
+
+if ($opt_h || @ARGV == 0) {
+    usage($ARGV[0]);
+}
+
+$num_lists = defined($opt_n) ? $opt_n : 8;
+$max_size = defined($opt_m) ? $opt_m : 4096;
+
+# The lists and the tree share seg_bitmap, and mm_stats reports each
+# list, the mini list and the tree
+if ($num_lists < 1 || $num_lists > 14) {
+    die "LISTS must be between 1 and 14\n";
+}
+# Tree nodes need at least 64 bytes
+if ($max_size < 128 || $max_size % $dsize != 0) {
+    die "MAX must be a multiple of $dsize, and at least 128\n";
+}
+
+%count = ();
+$requests = 0;
+$num_traces = 0;
+
+foreach $trace (@ARGV) {
+    open(TRACE, "<", $trace) || die "Couldn't open '$trace': $!\n";
+    # Header: weight, number of ids, number of ops, maximum bytes
+    $weight = <TRACE>;
+    <TRACE>; <TRACE>; <TRACE>;
+    if ($weight == 0) {
+        close(TRACE);
+        next;
+    }
+    $num_traces++;
+    while (<TRACE>) {
+        @f = split;
+        if ($f[0] eq "a" || $f[0] eq "c" || $f[0] eq "r") {
+            ($n, $bytes) = (1, $f[2]);
+        } elsif ($f[0] eq "m") {
+            ($n, $bytes) = (1, $f[3]);
+        } elsif ($f[0] eq "b") {
+            ($n, $bytes) = ($f[2], $f[3]);
+        } else {
+            next;
+        }
+        next if $bytes == 0;
+        $asize = $dsize * int(($bytes + $wsize + $dsize - 1) / $dsize);
+        next if $asize <= $mini_block_size || $asize > $max_size;
+        $count{$asize} += $n;
+        $requests += $n;
+    }
+    close(TRACE);
+}
+
+# Close a list whenever it has reached its share of the requests still to
+# be placed, so that a heavy size does not starve the lists after it
+@sizes = sort { $a <=> $b } keys %count;
+@bounds = ();
+$left = $requests;
+$in_list = 0;
+foreach $size (@sizes) {
+    last if @bounds == $num_lists - 1 || $size == $max_size;
+    $in_list += $count{$size};
+    if ($in_list * ($num_lists - @bounds) >= $left) {
+        push(@bounds, $size);
+        $left -= $in_list;
+        $in_list = 0;
+    }
+}
+
+# Lists the requests leave over double in size up to the last one
+$size = (@bounds > 0) ? $bounds[-1] : $mini_block_size;
+while (@bounds < $num_lists - 1 && 2 * $size < $max_size) {
+    $size *= 2;
+    push(@bounds, $size);
+}
+push(@bounds, $max_size);
+$num_lists = @bounds;
+
+if ($opt_o) {
+    open(OUT, ">", $opt_o) || die "Couldn't open '$opt_o': $!\n";
+} else {
+    open(OUT, ">&STDOUT");
+}
+
+print OUT <<"EOF";
+/*
+ * sizeclasses.h - Size classes of the segregated free lists of mm.c
+ *
+ * Generated by sizeclasses.pl from $num_traces traces, with $requests
+ * requests for blocks of up to $max_size bytes. Do not edit.
+ */
+
+#ifndef SIZECLASSES_H__
+#define SIZECLASSES_H__ 1
+
+/** \@brief Number of segregated free lists */
+#define NUM_SEG_LISTS $num_lists
+
+/** \@brief Largest block size of each list (bytes) */
+static const size_t seg_class_max[NUM_SEG_LISTS] = {
+EOF
+print OUT "    " . join(", ", @bounds) . ",\n};\n\n";
+
+print OUT "/** \@brief Size class of each block size up to $max_size, ";
+print OUT "indexed by size / $dsize */\n";
+print OUT "static const unsigned char seg_class_table[" .
+    ($max_size / $dsize + 1) . "] = {\n";
+$index = 0;
+for ($i = 0; $i <= $max_size / $dsize; $i++) {
+    $index++ while $i * $dsize > $bounds[$index];
+    print OUT (($i % 16 == 0) ? "    " : " ");
+    print OUT "$index,";
+    print OUT "\n" if $i % 16 == 15 || $i == $max_size / $dsize;
+}
+print OUT "};\n\n#endif /* sizeclasses.h */\n";
+close(OUT);
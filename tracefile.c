@@ -205,45 +205,96 @@ static unsigned long read_single_number(const char *line, unsigned long max,
     return val;
 }
 
-/** Read an 'a' or 'r' trace line (specifying a call to malloc
- *  or realloc, respectively).  The text at ARGS should match
- *  /[ \t]*[0-9]+[ \t]*[0-9]+/; the numbers are the block ID
- *  and the size to allocate or resize to, respectively.
+/** Split the first of several whitespace-separated fields off a
+ *  trace line.  The text at *ARGSP should match /[ \t]*[0-9]+[ \t]+/.
+ *  The field is NUL-terminated in place, and *ARGSP is advanced to the
+ *  start of the next field.
  *
- *  @param op      traceop_t object to be initialized.
- *  @param opcode  Value for the 'type' field of OP.
- *  @param args    Arguments for this trace line, as text.
+ *  @param argsp   Pointer to the remaining arguments, as text.
  *  @param fname   Trace file name (for error reporting).
  *  @param lineno  Trace line number (for error reporting).
+ *  @param what    Description of the field (for error reporting).
+ *  @return        The text of the field.
  */
-static void read_alloc_line(traceop_t *op, traceopcode_t opcode, char *args,
-                            const char *fname, unsigned int lineno) {
+static char *split_number_field(char **argsp, const char *fname,
+                                unsigned int lineno, const char *what) {
+    char *args = *argsp;
     while (*args == ' ' || *args == '\t') {
         args++;
     }
-    char *idtext = args;
+    char *text = args;
     while ('0' <= *args && *args <= '9') {
         args++;
     }
-    if (args == idtext) {
+    if (args == text) {
         app_error("%s:%u: error: invalid trace: "
-                  "while reading block ID, found a not-number",
-                  fname, lineno);
+                  "while reading %s, found a not-number",
+                  fname, lineno, what);
     }
     if (*args != ' ' && *args != '\t') {
         app_error("%s:%u: error: invalid trace: "
-                  "while reading block ID, junk after number",
-                  fname, lineno);
+                  "while reading %s, junk after number",
+                  fname, lineno, what);
     }
     *args++ = '\0';
     while (*args == ' ' || *args == '\t') {
         args++;
     }
+    *argsp = args;
+    return text;
+}
+
+/** Read an 'a', 'c' or 'r' trace line (specifying a call to malloc,
+ *  calloc or realloc, respectively).  The text at ARGS should match
+ *  /[ \t]*[0-9]+[ \t]*[0-9]+/; the numbers are the block ID
+ *  and the size to allocate or resize to, respectively.
+ *
+ *  @param op      traceop_t object to be initialized.
+ *  @param opcode  Value for the 'type' field of OP.
+ *  @param args    Arguments for this trace line, as text.
+ *  @param fname   Trace file name (for error reporting).
+ *  @param lineno  Trace line number (for error reporting).
+ */
+static void read_alloc_line(traceop_t *op, traceopcode_t opcode, char *args,
+                            const char *fname, unsigned int lineno) {
+    char *idtext = split_number_field(&args, fname, lineno, "block ID");
 
     op->type = opcode;
     op->lineno = lineno;
     op->index = (unsigned int)read_single_number(idtext, UINT_MAX, fname,
                                                  lineno, "block ID");
+    op->count = 1;
+    op->size = read_single_number(args, SIZE_MAX, fname, lineno, "block size");
+    op->alignment = 0;
+}
+
+/** Read an 'm' trace line (specifying a call to memalign).
+ *  The text at ARGS should match /[ \t]*[0-9]+[ \t]*[0-9]+[ \t]*[0-9]+/;
+ *  the numbers are the block ID, the alignment, and the size to
+ *  allocate, respectively.  The alignment must be a power of two.
+ *
+ *  @param op      traceop_t object to be initialized.
+ *  @param args    Arguments for this trace line, as text.
+ *  @param fname   Trace file name (for error reporting).
+ *  @param lineno  Trace line number (for error reporting).
+ */
+static void read_memalign_line(traceop_t *op, char *args, const char *fname,
+                               unsigned int lineno) {
+    char *idtext = split_number_field(&args, fname, lineno, "block ID");
+    char *aligntext = split_number_field(&args, fname, lineno, "alignment");
+
+    op->type = MEMALIGN;
+    op->lineno = lineno;
+    op->index = (unsigned int)read_single_number(idtext, UINT_MAX, fname,
+                                                 lineno, "block ID");
+    op->count = 1;
+    op->alignment =
+        read_single_number(aligntext, SIZE_MAX, fname, lineno, "alignment");
+    if (op->alignment == 0 || (op->alignment & (op->alignment - 1)) != 0) {
+        app_error("%s:%u: error: invalid trace: "
+                  "alignment is not a power of two",
+                  fname, lineno);
+    }
     op->size = read_single_number(args, SIZE_MAX, fname, lineno, "block size");
 }
 
@@ -266,6 +317,68 @@ static void read_free_line(traceop_t *op, char *args, const char *fname,
     op->lineno = lineno;
     op->index = (unsigned int)read_single_number(args, UINT_MAX, fname, lineno,
                                                  "block ID");
+    op->count = 1;
+    op->size = 0;
+    op->alignment = 0;
+}
+
+/** Read the block ID and block count that start a 'b' or 'B' trace
+ *  line, leaving *ARGSP at whatever follows the count.  The batch covers
+ *  the block IDs from ID to ID + COUNT - 1; COUNT must be at least 1.
+ *
+ *  @param op      traceop_t object whose index and count to set.
+ *  @param argsp   Pointer to the arguments for this trace line, as text.
+ *  @param last    True if the count is the last field on the line.
+ *  @param fname   Trace file name (for error reporting).
+ *  @param lineno  Trace line number (for error reporting).
+ */
+static void read_batch_fields(traceop_t *op, char **argsp, bool last,
+                              const char *fname, unsigned int lineno) {
+    char *idtext = split_number_field(argsp, fname, lineno, "block ID");
+    char *counttext =
+        last ? *argsp : split_number_field(argsp, fname, lineno, "count");
+
+    op->lineno = lineno;
+    op->index = (unsigned int)read_single_number(idtext, UINT_MAX, fname,
+                                                 lineno, "block ID");
+    op->count = (unsigned int)read_single_number(
+        counttext, UINT_MAX - op->index, fname, lineno, "count");
+    if (op->count == 0) {
+        app_error("%s:%u: error: invalid trace: empty batch", fname, lineno);
+    }
+    op->alignment = 0;
+}
+
+/** Read a 'b' trace line (specifying a call to malloc_batch).
+ *  The text at ARGS should match /[ \t]*[0-9]+[ \t]*[0-9]+[ \t]*[0-9]+/;
+ *  the numbers are the first block ID, the number of blocks, and the
+ *  size of each block, respectively.
+ *
+ *  @param op      traceop_t object to be initialized.
+ *  @param args    Arguments for this trace line, as text.
+ *  @param fname   Trace file name (for error reporting).
+ *  @param lineno  Trace line number (for error reporting).
+ */
+static void read_batch_alloc_line(traceop_t *op, char *args,
+                                  const char *fname, unsigned int lineno) {
+    op->type = BATCH_ALLOC;
+    read_batch_fields(op, &args, false, fname, lineno);
+    op->size = read_single_number(args, SIZE_MAX, fname, lineno, "block size");
+}
+
+/** Read a 'B' trace line (specifying a call to free_batch).
+ *  The text at ARGS should match /[ \t]*[0-9]+[ \t]*[0-9]+/; the
+ *  numbers are the first block ID and the number of blocks.
+ *
+ *  @param op      traceop_t object to be initialized.
+ *  @param args    Arguments for this trace line, as text.
+ *  @param fname   Trace file name (for error reporting).
+ *  @param lineno  Trace line number (for error reporting).
+ */
+static void read_batch_free_line(traceop_t *op, char *args, const char *fname,
+                                 unsigned int lineno) {
+    op->type = BATCH_FREE;
+    read_batch_fields(op, &args, true, fname, lineno);
     op->size = 0;
 }
 
@@ -317,6 +430,7 @@ trace_t *read_trace(const char *fname, unsigned int verbose) {
     trace->data_bytes = peak_bytes;
     trace->num_ids = num_ids;
     trace->num_ops = num_ops;
+    trace->num_blocks_ops = 0;
     trace->weight = weight_codes[iweight];
 
     // We'll store each request line in the trace in this array.
@@ -361,6 +475,9 @@ trace_t *read_trace(const char *fname, unsigned int verbose) {
         case 'a':
             read_alloc_line(&trace->ops[op], ALLOC, line + 1, fname, lineno);
             break;
+        case 'c':
+            read_alloc_line(&trace->ops[op], CALLOC, line + 1, fname, lineno);
+            break;
         case 'r':
             trace->ops[op].type = REALLOC;
             read_alloc_line(&trace->ops[op], REALLOC, line + 1, fname, lineno);
@@ -369,14 +486,25 @@ trace_t *read_trace(const char *fname, unsigned int verbose) {
             trace->ops[op].type = FREE;
             read_free_line(&trace->ops[op], line + 1, fname, lineno);
             break;
+        case 'm':
+            read_memalign_line(&trace->ops[op], line + 1, fname, lineno);
+            break;
+        case 'b':
+            read_batch_alloc_line(&trace->ops[op], line + 1, fname, lineno);
+            break;
+        case 'B':
+            read_batch_free_line(&trace->ops[op], line + 1, fname, lineno);
+            break;
         default:
             app_error("%s:%d: error: invalid trace: "
                       "unrecognized trace opcode '%c'",
                       fname, lineno, line[0]);
         }
-        if (trace->ops[op].index > max_id_used) {
-            max_id_used = trace->ops[op].index;
+        unsigned int last_id = trace->ops[op].index + trace->ops[op].count - 1;
+        if (last_id > max_id_used) {
+            max_id_used = last_id;
         }
+        trace->num_blocks_ops += trace->ops[op].count;
         op++;
     }
     if (op < num_ops) {
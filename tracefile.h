@@ -26,9 +26,13 @@ typedef enum weight_t {
  *  by this trace operation.
  */
 typedef enum traceopcode_t {
-    ALLOC,   /* 'a': call malloc */
-    FREE,    /* 'f': call free */
-    REALLOC, /* 'r': call realloc */
+    ALLOC,       /* 'a': call malloc */
+    CALLOC,      /* 'c': call calloc */
+    FREE,        /* 'f': call free */
+    REALLOC,     /* 'r': call realloc */
+    MEMALIGN,    /* 'm': call memalign */
+    BATCH_ALLOC, /* 'b': call malloc_batch */
+    BATCH_FREE,  /* 'B': call free_batch */
 } traceopcode_t;
 
 /** Description of a single trace operation (allocator request).  */
@@ -36,7 +40,9 @@ typedef struct traceop_t {
     traceopcode_t type : 8;   /* type of request (8 bits) */
     unsigned int lineno : 24; /* line number in trace file */
     unsigned int index;       /* block id, to use in realloc/free */
+    unsigned int count;       /* number of block ids of a batch request */
     size_t size;              /* byte size of alloc/realloc request */
+    size_t alignment;         /* alignment of memalign request */
 } traceop_t;
 
 /** Data structure corresponding to a complete trace file.  */
@@ -45,6 +51,7 @@ typedef struct trace_t {
     size_t data_bytes;    /* Peak number of data bytes allocated during trace */
     unsigned int num_ids; /* number of alloc/realloc ids */
     unsigned int num_ops; /* number of distinct requests */
+    unsigned int num_blocks_ops; /* same, counting each block of a batch */
     weight_t weight;      /* weight for this trace */
     traceop_t *ops;       /* array of requests */
     char **blocks;        /* array of ptrs returned by malloc/realloc... */